@@ -3,13 +3,22 @@
 #include <debug.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
+#include "devices/pci.h"
 #include "devices/timer.h"
+#include "devices/virtio-blk.h"
+#include "intrinsic.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
 
-/* The code in this file is an interface to an ATA (IDE)
-   controller.  It attempts to comply to [ATA-3]. */
+/* The code in this file is the generic disk layer, which gives
+   every kind of disk the same interface, followed by the driver
+   for ATA (IDE) disks.  The ATA driver attempts to comply to
+   [ATA-3]. */
 
 /* ATA command block port addresses. */
 #define reg_data(CHANNEL) ((CHANNEL)->reg_base + 0)     /* Data. */
@@ -32,6 +41,7 @@
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -47,20 +57,74 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_MULTIPLE 0xc4          /* READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE 0xc5         /* WRITE MULTIPLE. */
+#define CMD_SET_MULTIPLE_MODE 0xc6      /* SET MULTIPLE MODE. */
+#define CMD_READ_DMA 0xc8               /* READ DMA with retries. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA with retries. */
+#define CMD_FLUSH_CACHE 0xe7            /* FLUSH CACHE. */
+#define CMD_READ_SECTOR_EXT 0x24        /* READ SECTOR EXT. */
+#define CMD_WRITE_SECTOR_EXT 0x34       /* WRITE SECTOR EXT. */
+#define CMD_READ_MULTIPLE_EXT 0x29      /* READ MULTIPLE EXT. */
+#define CMD_WRITE_MULTIPLE_EXT 0x39     /* WRITE MULTIPLE EXT. */
+#define CMD_READ_DMA_EXT 0x25           /* READ DMA EXT. */
+#define CMD_WRITE_DMA_EXT 0x35          /* WRITE DMA EXT. */
+
+/* Sectors that 28-bit LBA can address.  Beyond them, the "EXT"
+   commands with 48-bit addresses are needed. */
+#define LBA28_SECTORS (1UL << 28)
+
+/* Bus master IDE port addresses, relative to a channel's BM_BASE.
+   See [SFF-8038i]. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0)  /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)   /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)     /* PRD table. */
+
+/* Bus master Command Register bits. */
+#define BM_CMD_START 0x01       /* Start transfer. */
+#define BM_CMD_READ 0x08        /* Transfer from disk to memory. */
+
+/* Bus master Status Register bits. */
+#define BM_STA_ERR 0x02         /* Transfer failed (write 1 to clear). */
+#define BM_STA_INTR 0x04        /* Disk interrupted (write 1 to clear). */
+
+/* A physical region descriptor: one physically contiguous piece
+   of the memory that a DMA transfer reads or writes.  A region
+   must not cross a 64 kB boundary. */
+struct prd {
+	uint32_t addr;              /* Physical address. */
+	uint16_t size;              /* Size in bytes, 0 for 64 kB. */
+	uint16_t flags;             /* PRD_EOT on the last region. */
+};
+#define PRD_EOT 0x8000          /* End of table. */
+#define PRD_MAX (PGSIZE / sizeof (struct prd))
+
+/* -pio: Never use DMA? */
+bool disk_pio;
+
+/* Registered disks, indexed by 2 * CHAN_NO + DEV_NO. */
+#define DISK_CNT 4
+static struct disk *disks[DISK_CNT];
 
 /* An ATA device. */
-struct disk {
-	char name[8];               /* Name, e.g. "hd0:1". */
+struct ata_disk {
+	struct disk disk;           /* Generic part, named e.g. "hd0:1". */
 	struct channel *channel;    /* Channel disk is on. */
 	int dev_no;                 /* Device 0 or 1 for master or slave. */
 
 	bool is_ata;                /* 1=This device is an ATA disk. */
-	disk_sector_t capacity;     /* Capacity in sectors (if is_ata). */
-
-	long long read_cnt;         /* Number of sectors read. */
-	long long write_cnt;        /* Number of sectors written. */
+	bool lba48;                 /* Supports 48-bit addresses? */
+	size_t multiple;            /* Sectors per interrupt of READ/WRITE
+								   MULTIPLE, or 0 if they are not used. */
+	bool dma_ok;                /* Can transfer by DMA? */
+	bool dma;                   /* Transfers by DMA when possible? */
+	disk_sector_t head;         /* Sector after the last request started. */
 };
 
+/* Returns the ATA disk whose generic part is D. */
+#define ata_of(D) ((struct ata_disk *) ((uint8_t *) (D) \
+			- offsetof (struct ata_disk, disk)))
+
 /* An ATA channel (aka controller).
    Each channel can control up to two disks. */
 struct channel {
@@ -68,12 +132,16 @@ struct channel {
 	uint16_t reg_base;          /* Base I/O port. */
 	uint8_t irq;                /* Interrupt in use. */
 
-	struct lock lock;           /* Must acquire to access the controller. */
 	bool expecting_interrupt;   /* True if an interrupt is expected, false if
 								   any interrupt would be spurious. */
 	struct semaphore completion_wait;   /* Up'd by interrupt handler. */
+	struct list queue;          /* Pending requests. */
+	struct semaphore queued;    /* Up'd for each request queued. */
 
-	struct disk devices[2];     /* The devices on this channel. */
+	uint16_t bm_base;           /* Bus master IDE base port, 0 if none. */
+	struct prd *prdt;           /* PRD table, one page. */
+
+	struct ata_disk devices[2]; /* The devices on this channel. */
 };
 
 /* We support the two "legacy" ATA channels found in a standard PC. */
@@ -81,98 +149,135 @@ struct channel {
 static struct channel channels[CHANNEL_CNT];
 
 static void reset_channel (struct channel *);
-static bool check_device_type (struct disk *);
-static void identify_ata_device (struct disk *);
-
-static void select_sector (struct disk *, disk_sector_t);
+static void ata_init (void);
+static void ata_submit (struct disk *, struct disk_request *);
+static void ata_flush (struct disk *);
+static bool check_device_type (struct ata_disk *);
+static void identify_ata_device (struct ata_disk *);
+static void set_multiple_mode (struct ata_disk *, size_t cnt);
+static uint16_t find_bus_master (void);
+
+static bool select_sector (struct ata_disk *, disk_sector_t, size_t cnt);
+static uint8_t ext_command (uint8_t command);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
-
-static void wait_until_idle (const struct disk *);
-static bool wait_while_busy (const struct disk *);
-static void select_device (const struct disk *);
-static void select_device_wait (const struct disk *);
+static void transfer_sync (struct disk *, disk_sector_t, size_t cnt,
+		bool write, void *, const void *const[]);
+static void complete_sync (struct disk_request *);
+static void record_latency (struct disk_latency *, uint64_t cycles);
+static void print_latency (const struct disk *, const char *what,
+		const struct disk_latency *);
+static struct disk_request *pick_request (struct channel *);
+static void channel_worker (void *);
+static bool serve_request (struct channel *, struct disk_request *);
+static bool transfer_block (struct channel *, struct disk_request *);
+static void recover_channel (struct channel *);
+static bool prdt_add (struct channel *, size_t *, const void *, size_t);
+static bool prdt_build (struct channel *, const struct disk_request *);
+
+static void wait_until_idle (const struct ata_disk *);
+static bool wait_while_busy (const struct ata_disk *);
+static void select_device (const struct ata_disk *);
+static void select_device_wait (const struct ata_disk *);
 
 static void interrupt_handler (struct intr_frame *);
 
+/* Operations on ATA disks. */
+static const struct disk_operations ata_operations = {
+	.submit = ata_submit,
+	.transfer = NULL,
+	.flush = ata_flush,
+};
+
 /* Initialize the disk subsystem and detect disks. */
 void
 disk_init (void) {
-	size_t chan_no;
+	ata_init ();
+	virtio_blk_init ();
 
-	for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++) {
-		struct channel *c = &channels[chan_no];
-		int dev_no;
-
-		/* Initialize channel. */
-		snprintf (c->name, sizeof c->name, "hd%zu", chan_no);
-		switch (chan_no) {
-			case 0:
-				c->reg_base = 0x1f0;
-				c->irq = 14 + 0x20;
-				break;
-			case 1:
-				c->reg_base = 0x170;
-				c->irq = 15 + 0x20;
-				break;
-			default:
-				NOT_REACHED ();
-		}
-		lock_init (&c->lock);
-		c->expecting_interrupt = false;
-		sema_init (&c->completion_wait, 0);
-
-		/* Initialize devices. */
-		for (dev_no = 0; dev_no < 2; dev_no++) {
-			struct disk *d = &c->devices[dev_no];
-			snprintf (d->name, sizeof d->name, "%s:%d", c->name, dev_no);
-			d->channel = c;
-			d->dev_no = dev_no;
-
-			d->is_ata = false;
-			d->capacity = 0;
-
-			d->read_cnt = d->write_cnt = 0;
-		}
-
-		/* Register interrupt handler. */
-		intr_register_ext (c->irq, interrupt_handler, c->name);
+	/* DO NOT MODIFY BELOW LINES. */
+	register_disk_inspect_intr ();
+}
 
-		/* Reset hardware. */
-		reset_channel (c);
+/* Makes D the disk numbered DEV_NO--either 0 or 1--within the
+   channel numbered CHAN_NO, in place of any disk there before.
+   D's driver must have set its name, capacity and operations. */
+void
+disk_register (struct disk *d, int chan_no, int dev_no) {
+	ASSERT (d != NULL && d->ops != NULL);
+	ASSERT ((d->ops->submit != NULL) != (d->ops->transfer != NULL));
+	ASSERT (chan_no >= 0 && chan_no < DISK_CNT / 2);
+	ASSERT (dev_no == 0 || dev_no == 1);
 
-		/* Distinguish ATA hard disks from other devices. */
-		if (check_device_type (&c->devices[0]))
-			check_device_type (&c->devices[1]);
+	d->read_cnt = d->write_cnt = 0;
+	memset (d->wait, 0, sizeof d->wait);
+	memset (d->service, 0, sizeof d->service);
+	d->depth = d->max_depth = 0;
+	d->depth_sum = d->submit_cnt = 0;
+	disks[chan_no * 2 + dev_no] = d;
+}
 
-		/* Read hard disk identity information. */
-		for (dev_no = 0; dev_no < 2; dev_no++)
-			if (c->devices[dev_no].is_ata)
-				identify_ata_device (&c->devices[dev_no]);
-	}
+/* Returns the number of sectors read from disk D so far. */
+long long
+disk_read_cnt (struct disk *d) {
+	ASSERT (d != NULL);
+	return d->read_cnt;
+}
 
-	/* DO NOT MODIFY BELOW LINES. */
-	register_disk_inspect_intr ();
+/* Returns the number of sectors written to disk D so far. */
+long long
+disk_write_cnt (struct disk *d) {
+	ASSERT (d != NULL);
+	return d->write_cnt;
 }
 
-/* Prints disk statistics. */
+/* Prints disk statistics: for each disk, the sectors moved, the
+   queue depth, and how long requests waited to be issued and then
+   took to serve, with a histogram of the latter. */
 void
 disk_print_stats (void) {
-	int chan_no;
-
-	for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++) {
-		int dev_no;
+	int i;
 
-		for (dev_no = 0; dev_no < 2; dev_no++) {
-			struct disk *d = disk_get (chan_no, dev_no);
-			if (d != NULL && d->is_ata)
-				printf ("%s: %lld reads, %lld writes\n",
-						d->name, d->read_cnt, d->write_cnt);
-		}
+	for (i = 0; i < DISK_CNT; i++) {
+		struct disk *d = disks[i];
+		if (d == NULL)
+			continue;
+
+		printf ("%s: %lld reads, %lld writes\n",
+				d->name, d->read_cnt, d->write_cnt);
+		if (d->submit_cnt == 0)
+			continue;
+		printf ("%s: %lld requests, queue depth %lld.%02lld average, "
+				"%d max\n", d->name, d->submit_cnt,
+				d->depth_sum / d->submit_cnt,
+				d->depth_sum * 100 / d->submit_cnt % 100, d->max_depth);
+		print_latency (d, "read wait", &d->wait[0]);
+		print_latency (d, "read service", &d->service[0]);
+		print_latency (d, "write wait", &d->wait[1]);
+		print_latency (d, "write service", &d->service[1]);
 	}
 }
 
+/* Prints latency statistics LAT of disk D, described by WHAT:
+   average and maximum, then the nonzero histogram buckets, each
+   as the power of 2 where it starts and its count. */
+static void
+print_latency (const struct disk *d, const char *what,
+		const struct disk_latency *lat) {
+	int i;
+
+	if (lat->cnt == 0)
+		return;
+	printf ("%s: %s: %llu cycles average, %llu max\n  ", d->name, what,
+			(unsigned long long) (lat->total / lat->cnt),
+			(unsigned long long) lat->max);
+	for (i = 0; i < DISK_HIST_BUCKETS; i++)
+		if (lat->hist[i] > 0)
+			printf (" 2^%d:%lld", i, lat->hist[i]);
+	printf ("\n");
+}
+
 /* Returns the disk numbered DEV_NO--either 0 or 1 for master or
    slave, respectively--within the channel numbered CHAN_NO.
 
@@ -186,11 +291,8 @@ struct disk *
 disk_get (int chan_no, int dev_no) {
 	ASSERT (dev_no == 0 || dev_no == 1);
 
-	if (chan_no < (int) CHANNEL_CNT) {
-		struct disk *d = &channels[chan_no].devices[dev_no];
-		if (d->is_ata)
-			return d;
-	}
+	if (chan_no < DISK_CNT / 2)
+		return disks[chan_no * 2 + dev_no];
 	return NULL;
 }
 
@@ -209,21 +311,10 @@ disk_size (struct disk *d) {
    per-disk locking is unneeded. */
 void
 disk_read (struct disk *d, disk_sector_t sec_no, void *buffer) {
-	struct channel *c;
-
 	ASSERT (d != NULL);
 	ASSERT (buffer != NULL);
 
-	c = d->channel;
-	lock_acquire (&c->lock);
-	select_sector (d, sec_no);
-	issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-	sema_down (&c->completion_wait);
-	if (!wait_while_busy (d))
-		PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-	input_sector (c, buffer);
-	d->read_cnt++;
-	lock_release (&c->lock);
+	transfer_sync (d, sec_no, 1, false, buffer, NULL);
 }
 
 /* Write sector SEC_NO to disk D from BUFFER, which must contain
@@ -233,23 +324,364 @@ disk_read (struct disk *d, disk_sector_t sec_no, void *buffer) {
    per-disk locking is unneeded. */
 void
 disk_write (struct disk *d, disk_sector_t sec_no, const void *buffer) {
-	struct channel *c;
+	ASSERT (d != NULL);
+	ASSERT (buffer != NULL);
+
+	transfer_sync (d, sec_no, 1, true, (void *) buffer, NULL);
+}
+
+/* Reads the CNT consecutive sectors starting at SEC_NO from disk
+   D into BUFFER, which must have room for CNT * DISK_SECTOR_SIZE
+   bytes.  Each DISK_MAX_SECTORS sectors make one request to D's
+   driver; an ATA disk serves one with a single READ DMA command
+   or, without DMA, a READ MULTIPLE command, which interrupts once
+   per block of sectors rather than once per sector.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+void
+disk_read_multi (struct disk *d, disk_sector_t sec_no, void *buffer,
+		size_t cnt) {
+	ASSERT (d != NULL);
+	ASSERT (buffer != NULL);
 
+	transfer_sync (d, sec_no, cnt, false, buffer, NULL);
+}
+
+/* Writes the CNT consecutive sectors starting at SEC_NO to disk D
+   from BUFFER, which must contain CNT * DISK_SECTOR_SIZE bytes.
+   Like disk_read_multi(), needs a request per DISK_MAX_SECTORS
+   sectors, each a single WRITE DMA or WRITE MULTIPLE command on an
+   ATA disk.  Returns after the disk has acknowledged receiving all
+   of the data.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+void
+disk_write_multi (struct disk *d, disk_sector_t sec_no, const void *buffer,
+		size_t cnt) {
 	ASSERT (d != NULL);
 	ASSERT (buffer != NULL);
 
-	c = d->channel;
-	lock_acquire (&c->lock);
-	select_sector (d, sec_no);
-	issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-	if (!wait_while_busy (d))
-		PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-	output_sector (c, buffer);
-	sema_down (&c->completion_wait);
-	d->write_cnt++;
-	lock_release (&c->lock);
+	transfer_sync (d, sec_no, cnt, true, (void *) buffer, NULL);
 }
-
+
+/* Writes the CNT consecutive sectors starting at SEC_NO to disk D,
+   sector SEC_NO + i from BUFFERS[i], which must contain
+   DISK_SECTOR_SIZE bytes.  Otherwise like disk_write_multi().
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+void
+disk_writev (struct disk *d, disk_sector_t sec_no,
+		const void *const buffers[], size_t cnt) {
+	ASSERT (d != NULL);
+	ASSERT (buffers != NULL);
+
+	transfer_sync (d, sec_no, cnt, true, NULL, buffers);
+}
+
+/* Hands request R to its disk's driver and returns without
+   waiting for it.  R must stay put until R->COMPLETE has been
+   called.
+   R->COMPLETE is called with interrupts off, from the driver's
+   interrupt handler or its own thread once the transfer is done,
+   so it must not sleep.  For a driver that does not have to wait
+   for the transfer, it is called before disk_submit() returns.
+   Since a driver may copy the data in a thread other than the
+   caller's, R's buffers must be in kernel memory. */
+void
+disk_submit (struct disk_request *r) {
+	struct disk *d;
+	enum intr_level old_level;
+
+	ASSERT (r != NULL && r->disk != NULL && r->complete != NULL);
+	ASSERT (r->cnt > 0 && r->cnt <= DISK_MAX_SECTORS);
+	ASSERT (r->buffers != NULL ? r->write : is_kernel_vaddr (r->buffer));
+	ASSERT (r->sec_no + r->cnt <= r->disk->capacity);
+
+	d = r->disk;
+	old_level = intr_disable ();
+	if (r->write)
+		d->write_cnt += r->cnt;
+	else
+		d->read_cnt += r->cnt;
+	d->depth++;
+	if (d->depth > d->max_depth)
+		d->max_depth = d->depth;
+	d->depth_sum += d->depth;
+	d->submit_cnt++;
+	r->submit_tsc = r->issue_tsc = rdtsc ();
+	if (d->ops->submit != NULL) {
+		d->ops->submit (d, r);
+		intr_set_level (old_level);
+		return;
+	}
+
+	/* Let interrupts in while the data is copied. */
+	intr_set_level (old_level);
+	d->ops->transfer (d, r);
+	old_level = intr_disable ();
+	disk_complete (r);
+	intr_set_level (old_level);
+}
+
+/* Called by a driver when it issues request R to the device.  A
+   driver that does not call it has R issued on submission. */
+void
+disk_issued (struct disk_request *r) {
+	r->issue_tsc = rdtsc ();
+}
+
+/* Called by a driver, with interrupts off, when request R is
+   done.  Records how long R took and calls R->COMPLETE. */
+void
+disk_complete (struct disk_request *r) {
+	struct disk *d = r->disk;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	record_latency (&d->wait[r->write], r->issue_tsc - r->submit_tsc);
+	record_latency (&d->service[r->write], rdtsc () - r->issue_tsc);
+	d->depth--;
+	r->complete (r);
+}
+
+/* Adds a latency of CYCLES to LAT. */
+static void
+record_latency (struct disk_latency *lat, uint64_t cycles) {
+	int bucket = 0;
+
+	while (bucket < DISK_HIST_BUCKETS - 1 && (cycles >> (bucket + 1)) != 0)
+		bucket++;
+	lat->hist[bucket]++;
+	lat->cnt++;
+	lat->total += cycles;
+	if (cycles > lat->max)
+		lat->max = cycles;
+}
+
+/* Makes disk D move any data it holds in a volatile write cache
+   to stable storage, and waits until it has. */
+void
+disk_flush (struct disk *d) {
+	ASSERT (d != NULL);
+
+	if (d->ops->flush != NULL)
+		d->ops->flush (d);
+}
+
+/* Makes ATA disk D transfer data by DMA if DMA is true and D and
+   its controller support it, and by PIO otherwise.  Requests
+   already started are not affected.  Returns true if D now uses
+   DMA, which is never for other kinds of disks. */
+bool
+disk_set_dma (struct disk *d, bool dma) {
+	struct ata_disk *a;
+
+	ASSERT (d != NULL);
+
+	if (d->ops != &ata_operations)
+		return false;
+	a = ata_of (d);
+	a->dma = dma && a->dma_ok;
+	return a->dma;
+}
+
+/* Number of requests that one synchronous transfer keeps queued
+   at a time. */
+#define SYNC_REQUESTS 2
+
+/* A request made on behalf of a synchronous caller. */
+struct sync_request {
+	struct disk_request r;
+	bool busy;                  /* Submitted and not yet complete? */
+	struct semaphore *done;     /* Up'd on completion. */
+};
+
+/* Transfers the CNT consecutive sectors starting at SEC_NO between
+   disk D and memory, writing them if WRITE is true, and waits for
+   the transfer to finish.  Sector i is at BUFFER + i *
+   DISK_SECTOR_SIZE or, if BUFFERS is nonnull, at BUFFERS[i].
+   Transfers larger than one request are split, with the next
+   piece queued while the previous one is in progress. */
+static void
+transfer_sync (struct disk *d, disk_sector_t sec_no, size_t cnt,
+		bool write, void *buffer, const void *const buffers[]) {
+	struct sync_request reqs[SYNC_REQUESTS];
+	struct semaphore done;
+	size_t pending = 0, i;
+
+	sema_init (&done, 0);
+	for (i = 0; i < SYNC_REQUESTS; i++)
+		reqs[i].busy = false;
+
+	while (cnt > 0) {
+		size_t n = cnt < DISK_MAX_SECTORS ? cnt : DISK_MAX_SECTORS;
+		struct sync_request *s;
+
+		if (pending == SYNC_REQUESTS) {
+			sema_down (&done);
+			pending--;
+		}
+		for (s = reqs; s->busy; s++)
+			continue;
+
+		s->busy = true;
+		s->done = &done;
+		s->r.disk = d;
+		s->r.sec_no = sec_no;
+		s->r.cnt = n;
+		s->r.write = write;
+		s->r.buffer = buffer;
+		s->r.buffers = buffers;
+		s->r.complete = complete_sync;
+		s->r.aux = s;
+		pending++;
+		disk_submit (&s->r);
+
+		sec_no += n;
+		cnt -= n;
+		if (buffers != NULL)
+			buffers += n;
+		else
+			buffer = (uint8_t *) buffer + n * DISK_SECTOR_SIZE;
+	}
+	while (pending-- > 0)
+		sema_down (&done);
+}
+
+/* Completion function of the requests of transfer_sync(). */
+static void
+complete_sync (struct disk_request *r) {
+	struct sync_request *s = r->aux;
+
+	s->busy = false;
+	sema_up (s->done);
+}
+
+/* ATA disks. */
+
+/* Detects the ATA disks on the two legacy channels and registers
+   them. */
+static void
+ata_init (void) {
+	uint16_t bm_base = disk_pio ? 0 : find_bus_master ();
+	size_t chan_no;
+
+	for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++) {
+		struct channel *c = &channels[chan_no];
+		int dev_no;
+
+		/* Initialize channel. */
+		snprintf (c->name, sizeof c->name, "hd%zu", chan_no);
+		switch (chan_no) {
+			case 0:
+				c->reg_base = 0x1f0;
+				c->irq = 14 + 0x20;
+				break;
+			case 1:
+				c->reg_base = 0x170;
+				c->irq = 15 + 0x20;
+				break;
+			default:
+				NOT_REACHED ();
+		}
+		c->expecting_interrupt = false;
+		sema_init (&c->completion_wait, 0);
+		list_init (&c->queue);
+		sema_init (&c->queued, 0);
+
+		/* Each channel has 8 bus master ports. */
+		c->bm_base = 0;
+		c->prdt = NULL;
+		if (bm_base != 0) {
+			c->prdt = palloc_get_page (0);
+			if (c->prdt != NULL && vtop (c->prdt) < (1ULL << 32))
+				c->bm_base = bm_base + chan_no * 8;
+		}
+
+		/* Initialize devices. */
+		for (dev_no = 0; dev_no < 2; dev_no++) {
+			struct ata_disk *d = &c->devices[dev_no];
+			snprintf (d->disk.name, sizeof d->disk.name, "%s:%d", c->name, dev_no);
+			d->disk.capacity = 0;
+			d->disk.ops = &ata_operations;
+			d->channel = c;
+			d->dev_no = dev_no;
+
+			d->is_ata = false;
+			d->lba48 = false;
+			d->multiple = 0;
+			d->dma_ok = d->dma = false;
+			d->head = 0;
+		}
+
+		/* Register interrupt handler. */
+		intr_register_ext (c->irq, interrupt_handler, c->name);
+
+		/* Reset hardware. */
+		reset_channel (c);
+
+		/* Distinguish ATA hard disks from other devices. */
+		if (check_device_type (&c->devices[0]))
+			check_device_type (&c->devices[1]);
+
+		/* Read hard disk identity information. */
+		for (dev_no = 0; dev_no < 2; dev_no++)
+			if (c->devices[dev_no].is_ata)
+				identify_ata_device (&c->devices[dev_no]);
+
+		/* Make the disks that identified themselves available, and
+		   start the thread that serves their requests. */
+		if (!c->devices[0].is_ata && !c->devices[1].is_ata)
+			continue;
+		for (dev_no = 0; dev_no < 2; dev_no++)
+			if (c->devices[dev_no].is_ata)
+				disk_register (&c->devices[dev_no].disk, chan_no, dev_no);
+		if (thread_create (c->name, PRI_MAX, channel_worker, c) == TID_ERROR)
+			PANIC ("%s: cannot start channel thread", c->name);
+	}
+}
+
+/* Queues request R for ATA disk D.  Interrupts must be off.
+   Each channel's thread serves its requests one at a time in
+   C-SCAN order: the disk's head sweeps toward higher sectors,
+   taking the pending request nearest ahead of it, and jumps back
+   to the lowest one when none is left ahead.  A request of the
+   same distance as an earlier one waits behind it. */
+static void
+ata_submit (struct disk *d, struct disk_request *r) {
+	struct channel *c = ata_of (d)->channel;
+
+	list_push_back (&c->queue, &r->elem);
+	sema_up (&c->queued);
+}
+
+/* Sends a FLUSH CACHE command to ATA disk D, queued like a
+   transfer as a request of 0 sectors, and waits for it to
+   finish. */
+static void
+ata_flush (struct disk *d) {
+	struct sync_request s;
+	struct semaphore done;
+	enum intr_level old_level;
+
+	sema_init (&done, 0);
+	s.busy = true;
+	s.done = &done;
+	s.r.disk = d;
+	s.r.sec_no = 0;
+	s.r.cnt = 0;
+	s.r.write = false;
+	s.r.buffer = NULL;
+	s.r.buffers = NULL;
+	s.r.complete = complete_sync;
+	s.r.aux = &s;
+
+	old_level = intr_disable ();
+	ata_submit (d, &s.r);
+	intr_set_level (old_level);
+	sema_down (&done);
+}
+
 /* Disk detection and identification. */
 
 static void print_ata_string (char *string, size_t size);
@@ -264,7 +696,7 @@ reset_channel (struct channel *c) {
 	/* The ATA reset sequence depends on which devices are present,
 	   so we start by detecting device presence. */
 	for (dev_no = 0; dev_no < 2; dev_no++) {
-		struct disk *d = &c->devices[dev_no];
+		struct ata_disk *d = &c->devices[dev_no];
 
 		select_device (d);
 
@@ -317,7 +749,7 @@ reset_channel (struct channel *c) {
    channel.  If D is device 1 (slave), the return value is not
    meaningful. */
 static bool
-check_device_type (struct disk *d) {
+check_device_type (struct ata_disk *d) {
 	struct channel *c = d->channel;
 	uint8_t error, lbam, lbah, status;
 
@@ -343,7 +775,7 @@ check_device_type (struct disk *d) {
    response.  Initializes D's capacity member based on the result
    and prints a message describing the disk to the console. */
 static void
-identify_ata_device (struct disk *d) {
+identify_ata_device (struct ata_disk *d) {
 	struct channel *c = d->channel;
 	uint16_t id[DISK_SECTOR_SIZE / 2];
 
@@ -361,20 +793,36 @@ identify_ata_device (struct disk *d) {
 	}
 	input_sector (c, id);
 
-	/* Calculate capacity. */
-	d->capacity = id[60] | ((uint32_t) id[61] << 16);
+	/* Calculate capacity.  Bit 10 of word 83 says whether the disk
+	   supports 48-bit addresses, in which case words 100 to 103 give
+	   its full capacity, of which we can use what a disk_sector_t
+	   can name. */
+	d->disk.capacity = id[60] | ((uint32_t) id[61] << 16);
+	d->lba48 = (id[83] & 0x400) != 0;
+	if (d->lba48) {
+		uint64_t capacity = id[100] | ((uint64_t) id[101] << 16)
+			| ((uint64_t) id[102] << 32) | ((uint64_t) id[103] << 48);
+		d->disk.capacity = capacity > UINT32_MAX ? UINT32_MAX : capacity;
+	}
+
+	/* Word 47 gives the most sectors the disk can transfer per
+	   interrupt with READ/WRITE MULTIPLE. */
+	set_multiple_mode (d, id[47] & 0xff);
+
+	/* Bit 8 of word 49 says whether the disk supports DMA. */
+	d->dma_ok = d->dma = d->channel->bm_base != 0 && (id[49] & 0x100) != 0;
 
 	/* Print identification message. */
-	printf ("%s: detected %'"PRDSNu" sector (", d->name, d->capacity);
-	if (d->capacity > 1024 / DISK_SECTOR_SIZE * 1024 * 1024)
+	printf ("%s: detected %'"PRDSNu" sector (", d->disk.name, d->disk.capacity);
+	if (d->disk.capacity > 1024 / DISK_SECTOR_SIZE * 1024 * 1024)
 		printf ("%"PRDSNu" GB",
-				d->capacity / (1024 / DISK_SECTOR_SIZE * 1024 * 1024));
-	else if (d->capacity > 1024 / DISK_SECTOR_SIZE * 1024)
-		printf ("%"PRDSNu" MB", d->capacity / (1024 / DISK_SECTOR_SIZE * 1024));
-	else if (d->capacity > 1024 / DISK_SECTOR_SIZE)
-		printf ("%"PRDSNu" kB", d->capacity / (1024 / DISK_SECTOR_SIZE));
+				d->disk.capacity / (1024 / DISK_SECTOR_SIZE * 1024 * 1024));
+	else if (d->disk.capacity > 1024 / DISK_SECTOR_SIZE * 1024)
+		printf ("%"PRDSNu" MB", d->disk.capacity / (1024 / DISK_SECTOR_SIZE * 1024));
+	else if (d->disk.capacity > 1024 / DISK_SECTOR_SIZE)
+		printf ("%"PRDSNu" kB", d->disk.capacity / (1024 / DISK_SECTOR_SIZE));
 	else
-		printf ("%"PRDSNu" byte", d->capacity * DISK_SECTOR_SIZE);
+		printf ("%"PRDSNu" byte", d->disk.capacity * DISK_SECTOR_SIZE);
 	printf (") disk, model \"");
 	print_ata_string ((char *) &id[27], 40);
 	printf ("\", serial \"");
@@ -382,6 +830,66 @@ identify_ata_device (struct disk *d) {
 	printf ("\"\n");
 }
 
+/* Sends a SET MULTIPLE MODE command to disk D to make READ/WRITE
+   MULTIPLE transfer the largest power of 2 sectors, up to CNT,
+   per interrupt.  Leaves D using READ/WRITE SECTOR for multiple
+   sector transfers if that fails. */
+static void
+set_multiple_mode (struct ata_disk *d, size_t cnt) {
+	struct channel *c = d->channel;
+	size_t block = 1;
+
+	d->multiple = 0;
+	while (block * 2 <= cnt)
+		block *= 2;
+	if (block < 2)
+		return;
+
+	select_device_wait (d);
+	outb (reg_nsect (c), block);
+	issue_pio_command (c, CMD_SET_MULTIPLE_MODE);
+	sema_down (&c->completion_wait);
+	wait_while_busy (d);
+	if ((inb (reg_status (c)) & STA_ERR) == 0)
+		d->multiple = block;
+}
+
+/* Returns the base port of the bus master registers of the first
+   PCI IDE controller that can do bus master DMA, after enabling
+   bus mastering on it, or 0 if there is none.  Only bus 0 is
+   scanned, which is where QEMU and Bochs put it. */
+static uint16_t
+find_bus_master (void) {
+	int dev, func;
+
+	for (dev = 0; dev < 32; dev++)
+		for (func = 0; func < 8; func++) {
+			uint32_t class, bar4;
+
+			if ((pci_read_config (dev, func, 0) & 0xffff) == 0xffff) {
+				if (func == 0)
+					break;
+				continue;
+			}
+
+			/* Class 1 (mass storage), subclass 1 (IDE), with bit 7
+			   of the programming interface set if it is a bus
+			   master. */
+			class = pci_read_config (dev, func, 0x08);
+			if ((class >> 16) != 0x0101 || (class & 0x8000) == 0)
+				continue;
+			bar4 = pci_read_config (dev, func, 0x20);
+			if ((bar4 & 1) == 0)
+				continue;
+
+			/* Enable I/O space access and bus mastering. */
+			pci_write_config (dev, func, 0x04,
+					pci_read_config (dev, func, 0x04) | 0x05);
+			return bar4 & 0xfffc;
+		}
+	return 0;
+}
+
 /* Prints STRING, which consists of SIZE bytes in a funky format:
    each pair of bytes is in reverse order.  Does not print
    trailing whitespace and/or nulls. */
@@ -402,22 +910,65 @@ print_ata_string (char *string, size_t size) {
 }
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
-static void
-select_sector (struct disk *d, disk_sector_t sec_no) {
+   writes SEC_NO and the number of sectors CNT to the disk's
+   sector selection registers.  (We use LBA mode.)  Returns true
+   if the sectors lie beyond 28-bit addresses, in which case a
+   48-bit address was written and the command must be the
+   ext_command() version. */
+static bool
+select_sector (struct ata_disk *d, disk_sector_t sec_no, size_t cnt) {
 	struct channel *c = d->channel;
+	uint64_t end = (uint64_t) sec_no + cnt;
 
-	ASSERT (sec_no < d->capacity);
-	ASSERT (sec_no < (1UL << 28));
+	ASSERT (cnt > 0 && cnt <= DISK_MAX_SECTORS);
+	ASSERT (end <= d->disk.capacity);
+	ASSERT (end <= LBA28_SECTORS || d->lba48);
 
 	select_device_wait (d);
-	outb (reg_nsect (c), 1);
+	if (end <= LBA28_SECTORS) {
+		outb (reg_nsect (c), cnt);    /* A count of 256 is written as 0. */
+		outb (reg_lbal (c), sec_no);
+		outb (reg_lbam (c), sec_no >> 8);
+		outb (reg_lbah (c), (sec_no >> 16));
+		outb (reg_device (c),
+				DEV_MBS | DEV_LBA | (d->dev_no == 1 ? DEV_DEV : 0) | (sec_no >> 24));
+		return false;
+	}
+
+	/* Each register takes the high-order byte first, then the
+	   low-order one.  Address bits 32 to 47 are always 0 for us. */
+	outb (reg_nsect (c), cnt >> 8);
+	outb (reg_lbal (c), sec_no >> 24);
+	outb (reg_lbam (c), 0);
+	outb (reg_lbah (c), 0);
+	outb (reg_nsect (c), cnt);
 	outb (reg_lbal (c), sec_no);
 	outb (reg_lbam (c), sec_no >> 8);
-	outb (reg_lbah (c), (sec_no >> 16));
-	outb (reg_device (c),
-			DEV_MBS | DEV_LBA | (d->dev_no == 1 ? DEV_DEV : 0) | (sec_no >> 24));
+	outb (reg_lbah (c), sec_no >> 16);
+	outb (reg_device (c), DEV_MBS | DEV_LBA | (d->dev_no == 1 ? DEV_DEV : 0));
+	return true;
+}
+
+/* Returns the version of 28-bit data transfer COMMAND that takes
+   a 48-bit address. */
+static uint8_t
+ext_command (uint8_t command) {
+	switch (command) {
+		case CMD_READ_SECTOR_RETRY:
+			return CMD_READ_SECTOR_EXT;
+		case CMD_WRITE_SECTOR_RETRY:
+			return CMD_WRITE_SECTOR_EXT;
+		case CMD_READ_MULTIPLE:
+			return CMD_READ_MULTIPLE_EXT;
+		case CMD_WRITE_MULTIPLE:
+			return CMD_WRITE_MULTIPLE_EXT;
+		case CMD_READ_DMA:
+			return CMD_READ_DMA_EXT;
+		case CMD_WRITE_DMA:
+			return CMD_WRITE_DMA_EXT;
+		default:
+			NOT_REACHED ();
+	}
 }
 
 /* Writes COMMAND to channel C and prepares for receiving a
@@ -446,6 +997,230 @@ output_sector (struct channel *c, const void *sector) {
 	outsw (reg_data (c), sector, DISK_SECTOR_SIZE / 2);
 }
 
+/* Removes and returns the request on channel C's queue, which
+   must not be empty, that comes next in C-SCAN order.  Counting
+   each request's distance ahead of its disk's head modulo 2**32
+   makes the lowest sector follow the highest. */
+static struct disk_request *
+pick_request (struct channel *c) {
+	struct disk_request *best = NULL;
+	disk_sector_t best_dist = 0;
+	struct list_elem *e;
+
+	for (e = list_begin (&c->queue); e != list_end (&c->queue);
+			e = list_next (e)) {
+		struct disk_request *r = list_entry (e, struct disk_request, elem);
+		disk_sector_t dist = r->sec_no - ata_of (r->disk)->head;
+
+		if (best == NULL || dist < best_dist) {
+			best = r;
+			best_dist = dist;
+		}
+	}
+	list_remove (&best->elem);
+	return best;
+}
+
+/* Thread that serves the requests queued on channel C, which
+   is AUX, one at a time.  Commands are issued and PIO data is
+   moved here, with interrupts on; the interrupt handler only
+   wakes this thread up.  A request whose disk stays busy for too
+   long is retried after resetting the channel. */
+static void
+channel_worker (void *c_) {
+	struct channel *c = c_;
+
+	for (;;) {
+		struct disk_request *r;
+		enum intr_level old_level;
+
+		sema_down (&c->queued);
+		old_level = intr_disable ();
+		r = pick_request (c);
+		if (r->cnt > 0)
+			ata_of (r->disk)->head = r->sec_no + r->cnt;
+		intr_set_level (old_level);
+
+		while (!serve_request (c, r)) {
+			printf ("%s: disk %s timed out, sector=%"PRDSNu", resetting\n",
+					r->disk->name, r->write ? "write" : "read",
+					(disk_sector_t) (r->sec_no + r->done));
+			recover_channel (c);
+		}
+
+		old_level = intr_disable ();
+		if (r->cnt == 0)
+			r->complete (r);    /* Flushes bypass disk_submit(). */
+		else
+			disk_complete (r);
+		intr_set_level (old_level);
+	}
+}
+
+/* Issues the command for request R on channel C and waits for it
+   to finish.  Data moves by DMA if R's disk uses it and R's
+   buffers allow it, and otherwise by PIO, a block of D->MULTIPLE
+   sectors (or 1) at a time.  Returns false if the disk stayed
+   busy for too long, in which case R must be started over. */
+static bool
+serve_request (struct channel *c, struct disk_request *r) {
+	struct ata_disk *d = ata_of (r->disk);
+	uint8_t command;
+
+	r->done = 0;
+	if (r->cnt == 0) {
+		/* A flush, from ata_flush(). */
+		r->dma = false;
+		select_device_wait (d);
+		issue_pio_command (c, CMD_FLUSH_CACHE);
+		sema_down (&c->completion_wait);
+		if ((inb (reg_status (c)) & STA_ERR) != 0)
+			printf ("%s: cache flush failed\n", d->disk.name);
+		return true;
+	}
+	disk_issued (r);
+	r->dma = d->dma && prdt_build (c, r);
+
+	if (r->dma) {
+		uint8_t bm_command = r->write ? 0 : BM_CMD_READ;
+		uint8_t status;
+
+		command = r->write ? CMD_WRITE_DMA : CMD_READ_DMA;
+		outl (reg_bm_prdt (c), vtop (c->prdt));
+		outb (reg_bm_command (c), bm_command);
+		outb (reg_bm_status (c), BM_STA_ERR | BM_STA_INTR);
+		if (select_sector (d, r->sec_no, r->cnt))
+			command = ext_command (command);
+		issue_pio_command (c, command);
+		outb (reg_bm_command (c), bm_command | BM_CMD_START);
+		sema_down (&c->completion_wait);
+
+		outb (reg_bm_command (c), bm_command);
+		status = inb (reg_bm_status (c));
+		outb (reg_bm_status (c), BM_STA_ERR | BM_STA_INTR);
+		if ((status & BM_STA_ERR) != 0 || (inb (reg_status (c)) & STA_ERR) != 0)
+			PANIC ("%s: disk DMA %s failed, sector=%"PRDSNu,
+					d->disk.name, r->write ? "write" : "read", r->sec_no);
+		return true;
+	}
+
+	if (d->multiple > 0)
+		command = r->write ? CMD_WRITE_MULTIPLE : CMD_READ_MULTIPLE;
+	else
+		command = r->write ? CMD_WRITE_SECTOR_RETRY : CMD_READ_SECTOR_RETRY;
+	if (select_sector (d, r->sec_no, r->cnt))
+		command = ext_command (command);
+	issue_pio_command (c, command);
+
+	/* The disk asks for each block to read with an interrupt.  It
+	   asks for the first block to write with DRQ, for each further
+	   one with an interrupt, and interrupts once more when it has
+	   taken in the last. */
+	while (r->done < r->cnt) {
+		if (!r->write || r->done > 0)
+			sema_down (&c->completion_wait);
+		if (!transfer_block (c, r))
+			return false;
+	}
+	if (r->write)
+		sema_down (&c->completion_wait);
+	return true;
+}
+
+/* Moves the next block of request R's sectors between memory and
+   channel C's data register by PIO, once the disk is ready for
+   it.  Returns false if the disk stays busy for too long. */
+static bool
+transfer_block (struct channel *c, struct disk_request *r) {
+	struct ata_disk *d = ata_of (r->disk);
+	size_t block = d->multiple > 0 ? d->multiple : 1;
+	size_t end = r->done + block < r->cnt ? r->done + block : r->cnt;
+
+	if (!wait_while_busy (d)) {
+		if ((inb (reg_alt_status (c)) & STA_BSY) != 0)
+			return false;
+		PANIC ("%s: disk %s failed, sector=%"PRDSNu, d->disk.name,
+				r->write ? "write" : "read", (disk_sector_t) (r->sec_no + r->done));
+	}
+	for (; r->done < end; r->done++) {
+		if (r->buffers != NULL)
+			output_sector (c, r->buffers[r->done]);
+		else if (r->write)
+			output_sector (c, (uint8_t *) r->buffer + r->done * DISK_SECTOR_SIZE);
+		else
+			input_sector (c, (uint8_t *) r->buffer + r->done * DISK_SECTOR_SIZE);
+	}
+	return true;
+}
+
+/* Resets channel C after a request on it timed out, forgetting
+   any interrupts of the abandoned command, and sets its disks'
+   multiple mode again. */
+static void
+recover_channel (struct channel *c) {
+	enum intr_level old_level;
+	int dev_no;
+
+	reset_channel (c);
+	old_level = intr_disable ();
+	sema_init (&c->completion_wait, 0);
+	intr_set_level (old_level);
+
+	for (dev_no = 0; dev_no < 2; dev_no++) {
+		struct ata_disk *d = &c->devices[dev_no];
+		if (d->is_ata && d->multiple > 0)
+			set_multiple_mode (d, d->multiple);
+	}
+}
+
+/* Appends the SIZE bytes at kernel address ADDR to channel C's
+   PRD table, which has *CNT entries so far, splitting them at page
+   boundaries.  Returns false if the memory cannot take part in a
+   DMA transfer or the table is full. */
+static bool
+prdt_add (struct channel *c, size_t *cnt, const void *addr, size_t size) {
+	const uint8_t *p = addr;
+
+	if (!is_kernel_vaddr (p) || ((uintptr_t) p & 1) != 0)
+		return false;
+	while (size > 0) {
+		size_t chunk = PGSIZE - pg_ofs (p);
+		uint64_t paddr = vtop (p);
+
+		if (chunk > size)
+			chunk = size;
+		if (*cnt >= PRD_MAX || paddr + chunk > (1ULL << 32))
+			return false;
+		c->prdt[*cnt].addr = paddr;
+		c->prdt[*cnt].size = chunk;
+		c->prdt[*cnt].flags = 0;
+		(*cnt)++;
+
+		p += chunk;
+		size -= chunk;
+	}
+	return true;
+}
+
+/* Fills channel C's PRD table to describe the memory of request R.
+   Returns false if R's buffers cannot be used for DMA, in which
+   case R has to use PIO. */
+static bool
+prdt_build (struct channel *c, const struct disk_request *r) {
+	size_t n = 0, i;
+
+	if (r->buffers == NULL) {
+		if (!prdt_add (c, &n, r->buffer, r->cnt * DISK_SECTOR_SIZE))
+			return false;
+	} else {
+		for (i = 0; i < r->cnt; i++)
+			if (!prdt_add (c, &n, r->buffers[i], DISK_SECTOR_SIZE))
+				return false;
+	}
+	c->prdt[n - 1].flags = PRD_EOT;
+	return true;
+}
+
 /* Low-level ATA primitives. */
 
 /* Wait up to 10 seconds for the controller to become idle, that
@@ -454,16 +1229,16 @@ output_sector (struct channel *c, const void *sector) {
    As a side effect, reading the status register clears any
    pending interrupt. */
 static void
-wait_until_idle (const struct disk *d) {
+wait_until_idle (const struct ata_disk *d) {
 	int i;
 
 	for (i = 0; i < 1000; i++) {
 		if ((inb (reg_status (d->channel)) & (STA_BSY | STA_DRQ)) == 0)
 			return;
-		timer_usleep (10);
+		timer_udelay (10);
 	}
 
-	printf ("%s: idle timeout\n", d->name);
+	printf ("%s: idle timeout\n", d->disk.name);
 }
 
 /* Wait up to 30 seconds for disk D to clear BSY,
@@ -471,13 +1246,13 @@ wait_until_idle (const struct disk *d) {
    The ATA standards say that a disk may take as long as that to
    complete its reset. */
 static bool
-wait_while_busy (const struct disk *d) {
+wait_while_busy (const struct ata_disk *d) {
 	struct channel *c = d->channel;
 	int i;
 
 	for (i = 0; i < 3000; i++) {
 		if (i == 700)
-			printf ("%s: busy, waiting...", d->name);
+			printf ("%s: busy, waiting...", d->disk.name);
 		if (!(inb (reg_alt_status (c)) & STA_BSY)) {
 			if (i >= 700)
 				printf ("ok\n");
@@ -492,20 +1267,20 @@ wait_while_busy (const struct disk *d) {
 
 /* Program D's channel so that D is now the selected disk. */
 static void
-select_device (const struct disk *d) {
+select_device (const struct ata_disk *d) {
 	struct channel *c = d->channel;
 	uint8_t dev = DEV_MBS;
 	if (d->dev_no == 1)
 		dev |= DEV_DEV;
 	outb (reg_device (c), dev);
 	inb (reg_alt_status (c));
-	timer_nsleep (400);
+	timer_ndelay (400);
 }
 
 /* Select disk D in its channel, as select_device(), but wait for
    the channel to become idle before and after. */
 static void
-select_device_wait (const struct disk *d) {
+select_device_wait (const struct ata_disk *d) {
 	wait_until_idle (d);
 	select_device (d);
 	wait_until_idle (d);
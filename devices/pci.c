@@ -0,0 +1,28 @@
+#include "devices/pci.h"
+#include "threads/io.h"
+
+/* The code in this file gives access to the configuration space
+   of the devices on PCI bus 0, through configuration mechanism
+   #1.  That is the only bus that QEMU and Bochs populate. */
+
+/* PCI configuration space access ports. */
+#define PCI_CONFIG_ADDR 0xcf8
+#define PCI_CONFIG_DATA 0xcfc
+
+/* Returns register REG of function FUNC of device DEV on PCI bus
+   0. */
+uint32_t
+pci_read_config (int dev, int func, int reg) {
+	outl (PCI_CONFIG_ADDR,
+			0x80000000 | (dev << 11) | (func << 8) | (reg & 0xfc));
+	return inl (PCI_CONFIG_DATA);
+}
+
+/* Sets register REG of function FUNC of device DEV on PCI bus 0
+   to VALUE. */
+void
+pci_write_config (int dev, int func, int reg, uint32_t value) {
+	outl (PCI_CONFIG_ADDR,
+			0x80000000 | (dev << 11) | (func << 8) | (reg & 0xfc));
+	outl (PCI_CONFIG_DATA, value);
+}
@@ -0,0 +1,84 @@
+#include "devices/ramdisk.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* The code in this file keeps disks in memory, so that the file
+   system and swap can run without paying for disk I/O. */
+
+/* Number of sectors in a page. */
+#define SECTORS_PER_PAGE (PGSIZE / DISK_SECTOR_SIZE)
+
+/* A disk in memory. */
+struct ramdisk {
+	struct disk disk;           /* Generic part. */
+	uint8_t **pages;            /* Data, SECTORS_PER_PAGE sectors a page. */
+};
+
+static void ramdisk_transfer (struct disk *, struct disk_request *);
+static uint8_t *sector_data (struct ramdisk *, disk_sector_t);
+
+/* Operations on RAM disks. */
+static const struct disk_operations ramdisk_operations = {
+	.submit = NULL,
+	.transfer = ramdisk_transfer,
+	.flush = NULL,
+};
+
+/* Creates and returns a zero-filled disk of SIZE sectors in
+   kernel memory, named NAME, for disk_register().  Panics if
+   memory runs out. */
+struct disk *
+ramdisk_create (const char *name, disk_sector_t size) {
+	size_t page_cnt = DIV_ROUND_UP (size, SECTORS_PER_PAGE);
+	struct ramdisk *rd;
+	size_t i;
+
+	rd = malloc (sizeof *rd);
+	if (rd == NULL)
+		PANIC ("%s: out of memory", name);
+	rd->pages = malloc (page_cnt * sizeof *rd->pages);
+	if (rd->pages == NULL)
+		PANIC ("%s: out of memory", name);
+	for (i = 0; i < page_cnt; i++) {
+		rd->pages[i] = palloc_get_page (PAL_ZERO);
+		if (rd->pages[i] == NULL)
+			PANIC ("%s: out of memory for %'"PRDSNu" sectors", name, size);
+	}
+
+	strlcpy (rd->disk.name, name, sizeof rd->disk.name);
+	rd->disk.capacity = size;
+	rd->disk.ops = &ramdisk_operations;
+	printf ("%s: %'"PRDSNu" sector RAM disk\n", name, size);
+	return &rd->disk;
+}
+
+/* Copies the data of request R between RAM disk D and memory. */
+static void
+ramdisk_transfer (struct disk *d, struct disk_request *r) {
+	struct ramdisk *rd = (struct ramdisk *) d;
+	size_t i;
+
+	for (i = 0; i < r->cnt; i++) {
+		uint8_t *data = sector_data (rd, r->sec_no + i);
+		uint8_t *buffer = (uint8_t *) r->buffer + i * DISK_SECTOR_SIZE;
+
+		if (r->buffers != NULL)
+			memcpy (data, r->buffers[i], DISK_SECTOR_SIZE);
+		else if (r->write)
+			memcpy (data, buffer, DISK_SECTOR_SIZE);
+		else
+			memcpy (buffer, data, DISK_SECTOR_SIZE);
+	}
+}
+
+/* Returns the data of sector SEC_NO of RD. */
+static uint8_t *
+sector_data (struct ramdisk *rd, disk_sector_t sec_no) {
+	return rd->pages[sec_no / SECTORS_PER_PAGE]
+		+ sec_no % SECTORS_PER_PAGE * DISK_SECTOR_SIZE;
+}
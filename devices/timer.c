@@ -28,6 +28,7 @@ static intr_handler_func timer_interrupt;
 static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
+static void real_time_delay (int64_t num, int32_t denom);
 static bool compare_timer_tick(const struct list_elem *a, const struct list_elem *b, void *aux);
 
 static struct list timer_list;
@@ -125,6 +126,25 @@ timer_nsleep (int64_t ns) {
 	real_time_sleep (ns, 1000 * 1000 * 1000);
 }
 
+/* Busy-waits for approximately US microseconds.  Interrupts need
+   not be turned on.
+
+   Busy waiting wastes CPU cycles, and busy waiting with
+   interrupts off for the interval between timer ticks or longer
+   will cause timer ticks to be lost.  Thus, use timer_usleep()
+   instead if interrupts are enabled. */
+void
+timer_udelay (int64_t us) {
+	real_time_delay (us, 1000 * 1000);
+}
+
+/* Busy-waits for approximately NS nanoseconds.  Interrupts need
+   not be turned on.  See timer_udelay(). */
+void
+timer_ndelay (int64_t ns) {
+	real_time_delay (ns, 1000 * 1000 * 1000);
+}
+
 /* Prints timer statistics. */
 void
 timer_print_stats (void) {
@@ -211,6 +231,15 @@ real_time_sleep (int64_t num, int32_t denom) {
 	}
 }
 
+/* Busy-wait for approximately NUM/DENOM seconds. */
+static void
+real_time_delay (int64_t num, int32_t denom) {
+	/* Scale the numerator and denominator down by 1000 to avoid
+	   the possibility of overflow. */
+	ASSERT (denom % 1000 == 0);
+	busy_wait (loops_per_tick * num / 1000 * TIMER_FREQ / (denom / 1000));
+}
+
 static bool compare_timer_tick(const struct list_elem *a, const struct list_elem *b, void *aux){
 	struct thread *ta = list_entry(a, struct thread, timer_elem);
 	struct thread *tb = list_entry(b, struct thread, timer_elem);
@@ -0,0 +1,449 @@
+#include "devices/virtio-blk.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include "devices/pci.h"
+#include "threads/interrupt.h"
+#include "threads/io.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* The code in this file drives virtio block devices through the
+   legacy virtio PCI interface that QEMU offers.  See [VIRTIO]
+   sections 2.4, 4.1.4.8 and 5.2. */
+
+/* PCI IDs of a transitional virtio block device. */
+#define VIRTIO_VENDOR 0x1af4
+#define VIRTIO_BLK_DEVICE 0x1001
+
+/* Number of devices, one for each ATA disk. */
+#define VIRTIO_BLK_CNT 4
+
+/* Legacy virtio header port addresses. */
+#define reg_host_features(V) ((V)->io_base + 0x00)  /* Device features. */
+#define reg_guest_features(V) ((V)->io_base + 0x04) /* Driver features. */
+#define reg_queue_pfn(V) ((V)->io_base + 0x08)      /* Queue page number. */
+#define reg_queue_size(V) ((V)->io_base + 0x0c)     /* Queue size (r/o). */
+#define reg_queue_select(V) ((V)->io_base + 0x0e)   /* Queue select. */
+#define reg_queue_notify(V) ((V)->io_base + 0x10)   /* Queue notify. */
+#define reg_status(V) ((V)->io_base + 0x12)         /* Device status. */
+#define reg_isr(V) ((V)->io_base + 0x13)            /* ISR status (r/o). */
+
+/* virtio-blk configuration port addresses. */
+#define reg_capacity(V) ((V)->io_base + 0x14)       /* Sectors, 64 bits. */
+#define reg_seg_max(V) ((V)->io_base + 0x20)        /* Segments per request. */
+
+/* Device Status Register bits. */
+#define STA_ACKNOWLEDGE 0x01    /* Guest found the device. */
+#define STA_DRIVER 0x02         /* Guest can drive the device. */
+#define STA_DRIVER_OK 0x04      /* Driver is ready. */
+#define STA_FAILED 0x80         /* Driver gave up on the device. */
+
+/* ISR Status Register bits. */
+#define ISR_QUEUE 0x01          /* Used ring was updated. */
+
+/* Feature bits. */
+#define F_SEG_MAX 0x04          /* SEG_MAX configuration field is valid. */
+
+/* A buffer descriptor. */
+struct vring_desc {
+	uint64_t addr;              /* Physical address. */
+	uint32_t len;               /* Size in bytes. */
+	uint16_t flags;             /* VRING_DESC_F_*. */
+	uint16_t next;              /* Next descriptor, with VRING_DESC_F_NEXT. */
+};
+#define VRING_DESC_F_NEXT 1     /* Buffer continues in NEXT. */
+#define VRING_DESC_F_WRITE 2    /* Device writes the buffer. */
+
+/* Ring of descriptor chains offered to the device. */
+struct vring_avail {
+	uint16_t flags;
+	uint16_t idx;               /* Where the driver puts the next entry. */
+	uint16_t ring[];            /* Head descriptors of the chains. */
+};
+
+/* Ring of descriptor chains the device is done with. */
+struct vring_used {
+	uint16_t flags;             /* VRING_USED_F_NO_NOTIFY. */
+	uint16_t idx;               /* Where the device puts the next entry. */
+	struct vring_used_elem {
+		uint32_t id;            /* Head descriptor of the chain. */
+		uint32_t len;           /* Bytes written to the chain. */
+	} ring[];
+};
+#define VRING_USED_F_NO_NOTIFY 1        /* Device needs no notifying. */
+
+/* Request header, the first buffer of every request. */
+struct virtio_blk_hdr {
+	uint32_t type;              /* T_IN or T_OUT. */
+	uint32_t reserved;
+	uint64_t sector;            /* First sector. */
+};
+#define T_IN 0                  /* Read. */
+#define T_OUT 1                 /* Write. */
+
+/* Request status, the last buffer of every request. */
+#define S_OK 0                  /* Success. */
+
+/* A request to the device, named by the head descriptor of its
+   chain.  One disk request becomes one of these, or several if
+   its memory needs more descriptors than the device takes at
+   once. */
+struct virtio_blk_slot {
+	struct virtio_blk_hdr hdr;  /* Read by the device. */
+	uint8_t status;             /* Written by the device. */
+	struct disk_request *r;     /* Disk request this is part of. */
+};
+
+/* A virtio block device. */
+struct virtio_blk {
+	struct disk disk;           /* Generic part, named e.g. "vd0:1". */
+	bool present;               /* Found and set up? */
+	int slot;                   /* PCI slot. */
+	uint16_t io_base;           /* Base I/O port. */
+	uint8_t irq;                /* Interrupt in use. */
+	size_t seg_max;             /* Most data descriptors per request. */
+
+	uint16_t queue_size;        /* Number of descriptors. */
+	struct vring_desc *desc;    /* Descriptor table. */
+	struct vring_avail *avail;  /* Available ring. */
+	volatile struct vring_used *used;   /* Used ring. */
+	struct virtio_blk_slot *slots;      /* One per descriptor. */
+	uint16_t free_head;         /* First free descriptor. */
+	size_t free_cnt;            /* Number of free descriptors. */
+	uint16_t avail_idx;         /* Next avail ring entry, not yet published. */
+	uint16_t last_used;         /* Next used ring entry to look at. */
+
+	struct list pending;        /* Disk requests not wholly posted yet. */
+};
+
+static struct virtio_blk devices[VIRTIO_BLK_CNT];
+
+static void virtio_blk_submit (struct disk *, struct disk_request *);
+static bool setup_device (struct virtio_blk *);
+static bool post_part (struct virtio_blk *, struct disk_request *);
+static void post_pending (struct virtio_blk *);
+static void complete_used (struct virtio_blk *);
+static uint16_t alloc_desc (struct virtio_blk *);
+static void free_chain (struct virtio_blk *, uint16_t head);
+static const void *sector_addr (const struct disk_request *, size_t);
+static void interrupt_handler (struct intr_frame *);
+
+/* Operations on virtio-blk disks.  Without the FLUSH feature
+   negotiated, the device completes writes only once they are
+   stable, so there is nothing to flush. */
+static const struct disk_operations virtio_blk_operations = {
+	.submit = virtio_blk_submit,
+	.transfer = NULL,
+	.flush = NULL,
+};
+
+/* Finds and sets up the virtio-blk devices in the PCI slots that
+   stand in for ATA disks, and registers those whose ATA disk is
+   missing. */
+void
+virtio_blk_init (void) {
+	size_t i;
+
+	for (i = 0; i < VIRTIO_BLK_CNT; i++) {
+		struct virtio_blk *v = &devices[i];
+		int chan_no = i / 2, dev_no = i % 2;
+		uint32_t bar0;
+
+		v->present = false;
+		v->slot = VIRTIO_BLK_SLOT + i;
+		if (disk_get (chan_no, dev_no) != NULL)
+			continue;
+		if (pci_read_config (v->slot, 0, 0x00)
+				!= (VIRTIO_BLK_DEVICE << 16 | VIRTIO_VENDOR))
+			continue;
+
+		/* The legacy interface is in I/O space, behind BAR 0. */
+		bar0 = pci_read_config (v->slot, 0, 0x10);
+		if ((bar0 & 1) == 0)
+			continue;
+		v->io_base = bar0 & 0xfffc;
+		v->irq = pci_read_config (v->slot, 0, 0x3c) & 0xff;
+
+		/* Enable I/O space access and bus mastering. */
+		pci_write_config (v->slot, 0, 0x04,
+				pci_read_config (v->slot, 0, 0x04) | 0x05);
+
+		snprintf (v->disk.name, sizeof v->disk.name, "vd%d:%d",
+				chan_no, dev_no);
+		v->disk.ops = &virtio_blk_operations;
+		if (!setup_device (v)) {
+			outb (reg_status (v), STA_FAILED);
+			printf ("%s: device in PCI slot %#x unusable\n",
+					v->disk.name, v->slot);
+			continue;
+		}
+		v->present = true;
+		printf ("%s: detected %'"PRDSNu" sector virtio disk\n",
+				v->disk.name, v->disk.capacity);
+		disk_register (&v->disk, chan_no, dev_no);
+	}
+}
+
+/* Hands disk request R to virtio-blk disk D, to be completed as
+   disk_submit() describes.  Requests are posted in the order they
+   come, as descriptors become free, and D is notified once for
+   each batch posted together.  Interrupts must be off. */
+static void
+virtio_blk_submit (struct disk *d, struct disk_request *r) {
+	struct virtio_blk *v = (struct virtio_blk *) d;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	r->done = 0;
+	r->parts = 0;
+	list_push_back (&v->pending, &r->elem);
+	post_pending (v);
+}
+
+/* Resets device V and sets up its request queue, following the
+   initialization sequence of [VIRTIO] 3.1.  Returns false if V
+   cannot be used. */
+static bool
+setup_device (struct virtio_blk *v) {
+	size_t avail_size, used_size;
+	uint32_t features;
+	uint8_t *ring;
+	uint16_t i;
+
+	outb (reg_status (v), 0);
+	outb (reg_status (v), STA_ACKNOWLEDGE);
+	outb (reg_status (v), STA_ACKNOWLEDGE | STA_DRIVER);
+
+	/* We use none of the optional features. */
+	features = inl (reg_host_features (v));
+	outl (reg_guest_features (v), 0);
+
+	/* Requests go through queue 0.  Its size is set by the device,
+	   and its rings go in physically contiguous pages: the
+	   descriptors and the available ring, then the used ring on a
+	   page of its own. */
+	outw (reg_queue_select (v), 0);
+	v->queue_size = inw (reg_queue_size (v));
+	if (v->queue_size < 3 || (v->queue_size & (v->queue_size - 1)) != 0
+			|| v->irq >= 16)
+		return false;
+	avail_size = ROUND_UP (sizeof *v->desc * v->queue_size
+			+ sizeof *v->avail + sizeof v->avail->ring[0] * (v->queue_size + 1),
+			PGSIZE);
+	used_size = ROUND_UP (sizeof *v->used
+			+ sizeof v->used->ring[0] * v->queue_size + sizeof (uint16_t), PGSIZE);
+	ring = palloc_get_multiple (PAL_ZERO, (avail_size + used_size) / PGSIZE);
+	v->slots = palloc_get_multiple (PAL_ZERO,
+			DIV_ROUND_UP (sizeof *v->slots * v->queue_size, PGSIZE));
+	if (ring == NULL || v->slots == NULL)
+		PANIC ("virtio-blk: out of memory for queue of %"PRIu16,
+				v->queue_size);
+
+	v->desc = (struct vring_desc *) ring;
+	v->avail = (struct vring_avail *) (ring + sizeof *v->desc * v->queue_size);
+	v->used = (struct vring_used *) (ring + avail_size);
+	for (i = 0; i < v->queue_size; i++)
+		v->desc[i].next = i + 1;
+	v->free_head = 0;
+	v->free_cnt = v->queue_size;
+	v->avail_idx = v->last_used = 0;
+	list_init (&v->pending);
+	outl (reg_queue_pfn (v), vtop (ring) >> 12);
+
+	/* Capacity beyond what a disk_sector_t can name is no use. */
+	v->disk.capacity = inl (reg_capacity (v));
+	if (inl (reg_capacity (v) + 4) != 0)
+		v->disk.capacity = UINT32_MAX;
+
+	/* Each request needs a descriptor for its header and one for
+	   its status besides those for its data. */
+	v->seg_max = v->queue_size - 2;
+	if ((features & F_SEG_MAX) != 0) {
+		uint32_t seg_max = inl (reg_seg_max (v));
+		if (seg_max > 0 && seg_max < v->seg_max)
+			v->seg_max = seg_max;
+	}
+
+	/* Devices may share an interrupt. */
+	for (i = 0; devices + i < v; i++)
+		if (devices[i].present && devices[i].irq == v->irq)
+			break;
+	if (devices + i == v)
+		intr_register_ext (v->irq + 0x20, interrupt_handler, "virtio-blk");
+
+	outb (reg_status (v), STA_ACKNOWLEDGE | STA_DRIVER | STA_DRIVER_OK);
+	return true;
+}
+
+/* Posts as much of V's pending disk requests as V has
+   descriptors free for, in order, and then notifies V once if
+   anything was posted, unless V has said it does not need it. */
+static void
+post_pending (struct virtio_blk *v) {
+	while (!list_empty (&v->pending)) {
+		struct disk_request *r = list_entry (list_front (&v->pending),
+				struct disk_request, elem);
+
+		if (!post_part (v, r))
+			break;
+		if (r->done == r->cnt)
+			list_pop_front (&v->pending);
+	}
+
+	if (v->avail->idx != v->avail_idx) {
+		/* The device must see the ring entries before the index
+		   that covers them, and we must see any NO_NOTIFY it sets
+		   after reading that index. */
+		barrier ();
+		v->avail->idx = v->avail_idx;
+		asm volatile ("mfence" : : : "memory");
+		if ((v->used->flags & VRING_USED_F_NO_NOTIFY) == 0)
+			outw (reg_queue_notify (v), 0);
+	}
+}
+
+/* Adds the next part of disk request R to V's available ring,
+   without publishing it: the sectors from R->DONE on whose memory
+   fits in V->SEG_MAX descriptors, merging physically contiguous
+   sectors into one descriptor.  Returns false, posting nothing,
+   if V has too few descriptors free. */
+static bool
+post_part (struct virtio_blk *v, struct disk_request *r) {
+	struct virtio_blk_slot *slot;
+	size_t segs = 0, end, i;
+	uint64_t seg_end = 0;
+	uint16_t head, prev, d;
+
+	/* Count the descriptors needed. */
+	for (end = r->done; end < r->cnt; end++) {
+		uint64_t paddr = vtop (sector_addr (r, end));
+		if (segs == 0 || paddr != seg_end) {
+			if (segs == v->seg_max)
+				break;
+			segs++;
+		}
+		seg_end = paddr + DISK_SECTOR_SIZE;
+	}
+	if (v->free_cnt < segs + 2)
+		return false;
+
+	/* Header. */
+	head = alloc_desc (v);
+	slot = &v->slots[head];
+	slot->hdr.type = r->write ? T_OUT : T_IN;
+	slot->hdr.reserved = 0;
+	slot->hdr.sector = r->sec_no + r->done;
+	slot->status = 0xff;
+	slot->r = r;
+	v->desc[head].addr = vtop (&slot->hdr);
+	v->desc[head].len = sizeof slot->hdr;
+	v->desc[head].flags = VRING_DESC_F_NEXT;
+	prev = head;
+
+	/* Data. */
+	for (i = r->done; i < end; i++) {
+		uint64_t paddr = vtop (sector_addr (r, i));
+		if (prev != head && paddr == v->desc[prev].addr + v->desc[prev].len) {
+			v->desc[prev].len += DISK_SECTOR_SIZE;
+			continue;
+		}
+		d = alloc_desc (v);
+		v->desc[prev].next = d;
+		v->desc[d].addr = paddr;
+		v->desc[d].len = DISK_SECTOR_SIZE;
+		v->desc[d].flags = VRING_DESC_F_NEXT | (r->write ? 0 : VRING_DESC_F_WRITE);
+		prev = d;
+	}
+
+	/* Status. */
+	d = alloc_desc (v);
+	v->desc[prev].next = d;
+	v->desc[d].addr = vtop (&slot->status);
+	v->desc[d].len = sizeof slot->status;
+	v->desc[d].flags = VRING_DESC_F_WRITE;
+
+	v->avail->ring[v->avail_idx++ % v->queue_size] = head;
+	if (r->parts == 0 && r->done == 0)
+		disk_issued (r);
+	r->done = end;
+	r->parts++;
+	return true;
+}
+
+/* Retires the requests that V has put on its used ring, calling
+   the completion function of each disk request whose last part
+   this was. */
+static void
+complete_used (struct virtio_blk *v) {
+	while (v->last_used != v->used->idx) {
+		uint16_t head;
+		struct virtio_blk_slot *slot;
+		struct disk_request *r;
+
+		barrier ();
+		head = v->used->ring[v->last_used++ % v->queue_size].id;
+		slot = &v->slots[head];
+		r = slot->r;
+		if (slot->status != S_OK)
+			PANIC ("%s: disk %s failed, sector=%"PRIu64, v->disk.name,
+					r->write ? "write" : "read", slot->hdr.sector);
+		free_chain (v, head);
+
+		if (--r->parts == 0 && r->done == r->cnt)
+			disk_complete (r);
+	}
+}
+
+/* Takes a descriptor off V's free list.  One must be free. */
+static uint16_t
+alloc_desc (struct virtio_blk *v) {
+	uint16_t d = v->free_head;
+
+	ASSERT (v->free_cnt > 0);
+	v->free_head = v->desc[d].next;
+	v->free_cnt--;
+	return d;
+}
+
+/* Returns the descriptor chain starting at HEAD to V's free
+   list. */
+static void
+free_chain (struct virtio_blk *v, uint16_t head) {
+	uint16_t d = head;
+
+	for (;;) {
+		bool more = (v->desc[d].flags & VRING_DESC_F_NEXT) != 0;
+		uint16_t next = v->desc[d].next;
+
+		v->desc[d].next = v->free_head;
+		v->free_head = d;
+		v->free_cnt++;
+		if (!more)
+			break;
+		d = next;
+	}
+}
+
+/* Returns the memory of sector I of disk request R. */
+static const void *
+sector_addr (const struct disk_request *r, size_t i) {
+	if (r->buffers != NULL)
+		return r->buffers[i];
+	return (const uint8_t *) r->buffer + i * DISK_SECTOR_SIZE;
+}
+
+/* virtio-blk interrupt handler.  Serves every device on the
+   interrupt line, since they may share it. */
+static void
+interrupt_handler (struct intr_frame *f) {
+	struct virtio_blk *v;
+
+	for (v = devices; v < devices + VIRTIO_BLK_CNT; v++)
+		if (v->present && f->vec_no == (uint64_t) v->irq + 0x20
+				&& (inb (reg_isr (v)) & ISR_QUEUE) != 0) {
+			complete_used (v);
+			post_pending (v);
+		}
+}
@@ -46,10 +46,11 @@ dir_open (struct inode *inode) {
  * Return true if successful, false on failure. */
 struct dir *
 dir_open_root (void) {
+#ifdef EFILESYS
+	return dir_open (inode_open (cluster_to_sector (ROOT_DIR_CLUSTER)));
+#else
 	return dir_open (inode_open (ROOT_DIR_SECTOR));
-	// printf("root cluster %d\n", ROOT_DIR_CLUSTER);
-	// printf("root sector %d\n", cluster_to_sector(ROOT_DIR_CLUSTER));
-	// return dir_open (inode_open(cluster_to_sector(ROOT_DIR_CLUSTER)));
+#endif
 }
 
 /* Opens and returns a new directory for the same inode as DIR.
@@ -1,4 +1,6 @@
 #include "filesys/fat.h"
+#include <bitmap.h>
+#include <round.h>
 #include "devices/disk.h"
 #include "filesys/filesys.h"
 #include "threads/malloc.h"
@@ -6,14 +8,28 @@
 #include <stdio.h>
 #include <string.h>
 
+/* FAT sectors written back with one disk request, at most. */
+#define FAT_FLUSH_SECTORS 8
+
+/* FAT entries in one sector. */
+#define FAT_PER_SECTOR (DISK_SECTOR_SIZE / sizeof (cluster_t))
+
+/* Cluster N covers sectors N * sectors_per_cluster onward, counting
+ * from the start of the disk.  Cluster 0 holds the boot sector,
+ * cluster ROOT_DIR_CLUSTER the root directory's inode, and the FAT
+ * follows; clusters from the first one past the FAT hold data. */
+
 /* Should be less than DISK_SECTOR_SIZE */
 struct fat_boot {
 	unsigned int magic;
-	unsigned int sectors_per_cluster; /* Fixed to 1 */
+	unsigned int sectors_per_cluster; /* Power of 2. */
 	unsigned int total_sectors;
 	unsigned int fat_start;
 	unsigned int fat_sectors; /* Size of FAT in sectors. */
 	unsigned int root_dir_cluster;
+	unsigned int free_clusters; /* Free clusters as of the last close. */
+	unsigned int next_cluster;  /* Where the next allocation search starts. */
+	unsigned int clean;         /* Closed cleanly since last opened? */
 };
 
 /* FAT FS */
@@ -21,15 +37,35 @@ struct fat_fs {
 	struct fat_boot bs;
 	unsigned int *fat;
 	unsigned int fat_length;
-	disk_sector_t data_start;
+	cluster_t data_start;       /* First data cluster. */
 	cluster_t last_clst;
-	struct lock write_lock;
+	struct bitmap *free_map;    /* Clusters in use, one bit each. */
+	struct bitmap *dirty_map;   /* FAT sectors changed in memory only. */
+	struct bitmap *loaded_map;  /* FAT sectors read into FAT so far. */
+	struct lock load_lock;      /* Serializes reading FAT sectors. */
+	unsigned int free_cnt;      /* Number of free clusters. */
+	cluster_t next_clst;        /* Next-fit cursor for allocation. */
+	struct lock write_lock;     /* Guards FAT updates and the above. */
 };
 
 static struct fat_fs *fat_fs;
 
+/* -cluster: Sectors per cluster to format with, 0 for
+ * SECTORS_PER_CLUSTER. */
+unsigned int format_cluster_sectors;
+
 void fat_boot_create (void);
 void fat_fs_init (void);
+static void fat_build_free_map (bool loaded);
+static void fat_load_all (void);
+static void fat_load (size_t sec);
+static bool fat_load_range (cluster_t start, cluster_t end);
+static cluster_t fat_scan_free (cluster_t start, cluster_t end);
+static void fat_build_dirty_map (bool dirty);
+static void fat_writeback (bool boot);
+static void fat_write_boot (void);
+static cluster_t fat_find_free (void);
+static cluster_t fat_find_run (cluster_t start, cluster_t end, size_t cnt);
 
 void
 fat_init (void) {
@@ -37,6 +73,8 @@ fat_init (void) {
 	fat_fs = calloc (1, sizeof (struct fat_fs));
 	if (fat_fs == NULL)
 		PANIC ("FAT init failed");
+	lock_init (&fat_fs->write_lock);
+	lock_init (&fat_fs->load_lock);
 
 	// Read boot sector from the disk
 	unsigned int *bounce = malloc (DISK_SECTOR_SIZE);
@@ -54,70 +92,124 @@ fat_init (void) {
 
 void
 fat_open (void) {
+	/* Right after formatting, the FAT that fat_create made is still
+	 * in memory, whole and written out, and is used as it is. */
+	bool loaded = fat_fs->fat != NULL;
+
 	// printf("fat_open %d\n", fat_fs->fat_length);
 	// printf("%p\n", fat_fs->fat);
-	fat_fs->fat = calloc (fat_fs->fat_length, sizeof (cluster_t));
-	// printf("load\n");
-	if (fat_fs->fat == NULL)
-		PANIC ("FAT load failed");
+	if (!loaded) {
+		fat_fs->fat = calloc (fat_fs->fat_length, sizeof (cluster_t));
+		// printf("load\n");
+		if (fat_fs->fat == NULL)
+			PANIC ("FAT load failed");
+		fat_fs->loaded_map = bitmap_create (fat_fs->bs.fat_sectors);
+		if (fat_fs->loaded_map == NULL)
+			PANIC ("FAT load failed");
+	}
+
+	if (fat_fs->bs.clean) {
+		/* The saved free count is right, so FAT sectors can wait to
+		 * be read until they are used.  Until the next clean close,
+		 * the count on disk is not to be trusted. */
+		fat_build_free_map (loaded);
+		fat_fs->bs.clean = false;
+		fat_write_boot ();
+	} else {
+		if (!loaded)
+			fat_load_all ();
+		fat_build_free_map (true);
+	}
+	fat_build_dirty_map (false);
+}
+
+/* Reads the whole FAT from disk, as needed to recount free clusters
+ * after an unclean shutdown. */
+static void
+fat_load_all (void) {
 	// Load FAT directly from the disk
 	uint8_t *buffer = (uint8_t *) fat_fs->fat;
 	off_t bytes_read = 0;
 	off_t bytes_left = sizeof (fat_fs->fat);
 	const off_t fat_size_in_bytes = fat_fs->fat_length * sizeof (cluster_t);
-	for (unsigned i = 0; i < fat_fs->bs.fat_sectors; i++) {
-		bytes_left = fat_size_in_bytes - bytes_read;
-		if (bytes_left >= DISK_SECTOR_SIZE) {
-			disk_read (filesys_disk, fat_fs->bs.fat_start + i,
-			           buffer + bytes_read);
-			bytes_read += DISK_SECTOR_SIZE;
-		} else {
-			uint8_t *bounce = malloc (DISK_SECTOR_SIZE);
-			if (bounce == NULL)
-				PANIC ("FAT load failed");
-			disk_read (filesys_disk, fat_fs->bs.fat_start + i, bounce);
-			memcpy (buffer + bytes_read, bounce, bytes_left);
-			bytes_read += bytes_left;
-			free (bounce);
-		}
+	/* Read all the whole sectors with one request. */
+	unsigned full = fat_size_in_bytes / DISK_SECTOR_SIZE;
+	if (full > fat_fs->bs.fat_sectors)
+		full = fat_fs->bs.fat_sectors;
+	disk_read_multi (filesys_disk, fat_fs->bs.fat_start, buffer, full);
+	bytes_read = full * DISK_SECTOR_SIZE;
+	bytes_left = fat_size_in_bytes - bytes_read;
+	if (full < fat_fs->bs.fat_sectors && bytes_left > 0) {
+		uint8_t *bounce = malloc (DISK_SECTOR_SIZE);
+		if (bounce == NULL)
+			PANIC ("FAT load failed");
+		disk_read (filesys_disk, fat_fs->bs.fat_start + full, bounce);
+		memcpy (buffer + bytes_read, bounce, bytes_left);
+		bytes_read += bytes_left;
+		free (bounce);
 	}
 	// printf("byte read %d\n", bytes_read);
+	bitmap_set_all (fat_fs->loaded_map, true);
+}
+
+/* Reads FAT sector SEC into the table through the buffer cache, if
+ * it has not been read yet, and marks the clusters it shows in use
+ * in the free map.  Asks the cache to read the next FAT sector
+ * ahead, since chains and the allocator tend to move forward.
+ * The cached copy is dropped once it is in the table, since
+ * fat_writeback() writes the sector without the cache. */
+static void
+fat_load (size_t sec) {
+	size_t ofs = sec * FAT_PER_SECTOR, i, cnt;
+	const uint8_t *data;
+
+	if (fat_fs->loaded_map == NULL || bitmap_test (fat_fs->loaded_map, sec))
+		return;
+
+	lock_acquire (&fat_fs->load_lock);
+	if (!bitmap_test (fat_fs->loaded_map, sec)) {
+		cnt = fat_fs->fat_length - ofs < FAT_PER_SECTOR
+			? fat_fs->fat_length - ofs : FAT_PER_SECTOR;
+		data = buffer_cache_pin (fat_fs->bs.fat_start + sec, true);
+		memcpy (fat_fs->fat + ofs, data, cnt * sizeof (cluster_t));
+		buffer_cache_unpin (data, false);
+		buffer_cache_discard (fat_fs->bs.fat_start + sec);
+		for (i = ofs; i < ofs + cnt; i++)
+			if (fat_fs->fat[i] != 0)
+				bitmap_mark (fat_fs->free_map, i);
+		barrier ();
+		bitmap_mark (fat_fs->loaded_map, sec);
+
+		if (sec + 1 < fat_fs->bs.fat_sectors
+				&& !bitmap_test (fat_fs->loaded_map, sec + 1))
+			buffer_cache_readahead (fat_fs->bs.fat_start + sec + 1);
+	}
+	lock_release (&fat_fs->load_lock);
+}
+
+/* Reads the FAT sectors that describe clusters START up to END,
+ * exclusive.  Returns true if any had to be read. */
+static bool
+fat_load_range (cluster_t start, cluster_t end) {
+	size_t sec;
+	bool loaded = false;
+
+	for (sec = start / FAT_PER_SECTOR; sec <= (end - 1) / FAT_PER_SECTOR; sec++)
+		if (!bitmap_test (fat_fs->loaded_map, sec)) {
+			fat_load (sec);
+			loaded = true;
+		}
+	return loaded;
 }
 
 void
 fat_close (void) {
-	// Write FAT boot sector
 	// printf("fat close\n");
-	uint8_t *bounce = calloc (1, DISK_SECTOR_SIZE);
-	if (bounce == NULL)
-		PANIC ("FAT close failed");
-	memcpy (bounce, &fat_fs->bs, sizeof (fat_fs->bs));
-	disk_write (filesys_disk, FAT_BOOT_SECTOR, bounce);
-	free (bounce);
-
-	// Write FAT directly to the disk
-	uint8_t *buffer = (uint8_t *) fat_fs->fat;
-	off_t bytes_wrote = 0;
-	off_t bytes_left = sizeof (fat_fs->fat);
-	const off_t fat_size_in_bytes = fat_fs->fat_length * sizeof (cluster_t);
-	// printf("close %d %d\n", fat_fs->bs.fat_sectors, fat_size_in_bytes);
-	for (unsigned i = 0; i < fat_fs->bs.fat_sectors; i++) {
-		bytes_left = fat_size_in_bytes - bytes_wrote;
-		if (bytes_left >= DISK_SECTOR_SIZE) {
-			disk_write (filesys_disk, fat_fs->bs.fat_start + i,
-			            buffer + bytes_wrote);
-			bytes_wrote += DISK_SECTOR_SIZE;
-		} else {
-			bounce = calloc (1, DISK_SECTOR_SIZE);
-			if (bounce == NULL)
-				PANIC ("FAT close failed");
-			memcpy (bounce, buffer + bytes_wrote, bytes_left);
-			disk_write (filesys_disk, fat_fs->bs.fat_start + i, bounce);
-			bytes_wrote += bytes_left;
-			free (bounce);
-		}
-	}
-	// printf("close bytes writtedn %d\n", bytes_wrote);
+	/* Only the FAT sectors that changed since the last flush need
+	 * to be written, ahead of the boot sector that says they are
+	 * all there. */
+	fat_fs->bs.clean = true;
+	fat_writeback (true);
 }
 
 void
@@ -131,6 +223,11 @@ fat_create (void) {
 	fat_fs->fat = calloc (fat_fs->fat_length, sizeof (cluster_t));
 	if (fat_fs->fat == NULL)
 		PANIC ("FAT creation failed");
+	fat_fs->loaded_map = bitmap_create (fat_fs->bs.fat_sectors);
+	if (fat_fs->loaded_map == NULL)
+		PANIC ("FAT creation failed");
+	bitmap_set_all (fat_fs->loaded_map, true);
+	fat_build_dirty_map (true);
 
 	// Set up ROOT_DIR_CLST
 	fat_put (ROOT_DIR_CLUSTER, EOChain);
@@ -155,20 +252,29 @@ fat_create (void) {
 	}
 	fat_put(0, EOChain);
 	fat_put(1, EOChain);
-	fat_put(fat_fs->bs.fat_start+fat_fs->bs.fat_sectors-1, EOChain);
+	fat_put(fat_fs->data_start-1, EOChain);
 	fat_put(fat_fs->last_clst, EOChain);
+	fat_build_free_map (true);
 }
 
 void
 fat_boot_create (void) {
+	unsigned int sectors_per_cluster = format_cluster_sectors > 0
+	    ? format_cluster_sectors : SECTORS_PER_CLUSTER;
+	/* Clusters are numbered from the start of the disk, so the FAT
+	 * needs an entry for every cluster the disk holds. */
 	unsigned int fat_sectors =
-	    (disk_size (filesys_disk) - 1)
-	    / (DISK_SECTOR_SIZE / sizeof (cluster_t) * SECTORS_PER_CLUSTER + 1) + 1;
+	    DIV_ROUND_UP (disk_size (filesys_disk) / sectors_per_cluster
+	                  * sizeof (cluster_t), DISK_SECTOR_SIZE);
+
+	ASSERT (sectors_per_cluster > 0
+	        && (sectors_per_cluster & (sectors_per_cluster - 1)) == 0
+	        && sectors_per_cluster <= MAX_SECTORS_PER_CLUSTER);
 	fat_fs->bs = (struct fat_boot){
 	    .magic = FAT_MAGIC,
-	    .sectors_per_cluster = SECTORS_PER_CLUSTER,
+	    .sectors_per_cluster = sectors_per_cluster,
 	    .total_sectors = disk_size (filesys_disk),
-	    .fat_start = 2,
+	    .fat_start = (ROOT_DIR_CLUSTER + 1) * sectors_per_cluster,
 	    .fat_sectors = fat_sectors,
 	    .root_dir_cluster = ROOT_DIR_CLUSTER,
 	};
@@ -182,15 +288,200 @@ fat_fs_init (void) {
 	// fat_fs->last_clst = 2;
 	// fat_fs->fat = NULL;
 	fat_fs->fat = NULL;
-    fat_fs->fat_length = fat_fs->bs.total_sectors;
-    fat_fs->data_start = fat_fs->bs.fat_start+fat_fs->bs.fat_sectors;
-    fat_fs->last_clst = fat_fs->bs.total_sectors-1;
+    fat_fs->fat_length = fat_fs->bs.total_sectors / fat_fs->bs.sectors_per_cluster;
+	/* Disks formatted with a FAT too small for every sector leave
+	 * the sectors it cannot describe unused. */
+	if (fat_fs->fat_length > fat_fs->bs.fat_sectors * (DISK_SECTOR_SIZE / sizeof (cluster_t)))
+		fat_fs->fat_length = fat_fs->bs.fat_sectors * (DISK_SECTOR_SIZE / sizeof (cluster_t));
+    fat_fs->data_start = DIV_ROUND_UP (fat_fs->bs.fat_start + fat_fs->bs.fat_sectors,
+	                                   fat_fs->bs.sectors_per_cluster);
+    fat_fs->last_clst = fat_fs->fat_length-1;
 	// printf("fat_length %d \n", fat_fs->fat_length);
 	// printf("data_start %d \n", fat_fs->data_start);
 	// printf("last_clst  %d \n", fat_fs->last_clst);
 	
 }
 
+/* Rebuilds the free map.  Clusters before the data area are never
+ * free.  If LOADED is true, the whole FAT is in memory, and a
+ * cluster is free if its entry is 0; the free count is recounted.
+ * Otherwise the count saved at the last clean close is taken as
+ * is, and clusters stay marked free until their FAT sector is read
+ * and shows otherwise, which the allocator checks for. */
+static void
+fat_build_free_map (bool loaded) {
+	cluster_t clst;
+
+	if (fat_fs->free_map != NULL)
+		bitmap_destroy (fat_fs->free_map);
+	fat_fs->free_map = bitmap_create (fat_fs->last_clst + 1);
+	if (fat_fs->free_map == NULL)
+		PANIC ("FAT free map creation failed");
+
+	bitmap_set_multiple (fat_fs->free_map, 0, fat_fs->data_start, true);
+	fat_fs->free_cnt = fat_fs->bs.free_clusters;
+	if (loaded) {
+		fat_fs->free_cnt = 0;
+		for (clst = fat_fs->data_start; clst <= fat_fs->last_clst; clst++) {
+			if (fat_fs->fat[clst] != 0)
+				bitmap_mark (fat_fs->free_map, clst);
+			else
+				fat_fs->free_cnt++;
+		}
+	}
+
+	fat_fs->next_clst = fat_fs->bs.next_cluster;
+	if (fat_fs->next_clst < fat_fs->data_start
+			|| fat_fs->next_clst > fat_fs->last_clst)
+		fat_fs->next_clst = fat_fs->data_start;
+}
+
+/* Creates the map of FAT sectors that differ from their copy on
+ * disk, with every sector in it if DIRTY is true, as for a new FAT,
+ * and none otherwise. */
+static void
+fat_build_dirty_map (bool dirty) {
+	if (fat_fs->dirty_map != NULL)
+		bitmap_destroy (fat_fs->dirty_map);
+	fat_fs->dirty_map = bitmap_create (fat_fs->bs.fat_sectors);
+	if (fat_fs->dirty_map == NULL)
+		PANIC ("FAT dirty map creation failed");
+	bitmap_set_all (fat_fs->dirty_map, dirty);
+}
+
+/* Writes the boot sector, with the current free count and
+ * allocation cursor. */
+static void
+fat_write_boot (void) {
+	uint8_t *bounce = calloc (1, DISK_SECTOR_SIZE);
+	if (bounce == NULL)
+		PANIC ("FAT boot sector write failed");
+	lock_acquire (&fat_fs->write_lock);
+	fat_fs->bs.free_clusters = fat_fs->free_cnt;
+	fat_fs->bs.next_cluster = fat_fs->next_clst;
+	memcpy (bounce, &fat_fs->bs, sizeof (fat_fs->bs));
+	lock_release (&fat_fs->write_lock);
+	disk_write (filesys_disk, FAT_BOOT_SECTOR, bounce);
+	free (bounce);
+}
+
+/* Writes the FAT sectors in the dirty map back to disk, adjacent
+ * ones together, and then the boot sector if any were written or
+ * BOOT is true.  Each run is copied out under the lock and written
+ * without it, so allocation goes on meanwhile; an entry changed
+ * after the copy marks its sector dirty again.  The writes bypass
+ * the buffer cache, so any copy of the sectors that read-ahead
+ * left in it is dropped first. */
+static void
+fat_writeback (bool boot) {
+	const size_t fat_bytes = fat_fs->fat_length * sizeof (cluster_t);
+	size_t sec = 0, cnt, ofs, len, i;
+	uint8_t *bounce;
+
+	bounce = malloc (FAT_FLUSH_SECTORS * DISK_SECTOR_SIZE);
+	if (bounce == NULL)
+		PANIC ("FAT writeback failed");
+	for (;;) {
+		lock_acquire (&fat_fs->write_lock);
+		sec = bitmap_scan (fat_fs->dirty_map, sec, 1, true);
+		if (sec == BITMAP_ERROR) {
+			lock_release (&fat_fs->write_lock);
+			break;
+		}
+		for (cnt = 1; cnt < FAT_FLUSH_SECTORS
+				&& sec + cnt < bitmap_size (fat_fs->dirty_map)
+				&& bitmap_test (fat_fs->dirty_map, sec + cnt); cnt++)
+			continue;
+		bitmap_set_multiple (fat_fs->dirty_map, sec, cnt, false);
+
+		ofs = sec * DISK_SECTOR_SIZE;
+		len = cnt * DISK_SECTOR_SIZE;
+		memset (bounce, 0, len);
+		memcpy (bounce, (uint8_t *) fat_fs->fat + ofs,
+				fat_bytes - ofs < len ? fat_bytes - ofs : len);
+		lock_release (&fat_fs->write_lock);
+
+		for (i = 0; i < cnt; i++)
+			buffer_cache_discard (fat_fs->bs.fat_start + sec + i);
+		disk_write_multi (filesys_disk, fat_fs->bs.fat_start + sec, bounce, cnt);
+		sec += cnt;
+		boot = true;
+	}
+	free (bounce);
+
+	if (boot)
+		fat_write_boot ();
+}
+
+/* Writes the FAT changes made since the last flush to disk. */
+void
+fat_flush (void) {
+	if (fat_fs != NULL && fat_fs->dirty_map != NULL)
+		fat_writeback (false);
+}
+
+/* Returns a free cluster, or 0 if there is none.  The search is
+ * next fit: it starts where the last one left off and wraps
+ * around to the start of the data area, so that allocation does
+ * not rescan the full front of a filling disk every time. */
+static cluster_t
+fat_find_free (void) {
+	size_t clst;
+
+	ASSERT (lock_held_by_current_thread (&fat_fs->write_lock));
+
+	if (fat_fs->free_cnt == 0)
+		return 0;
+	clst = fat_scan_free (fat_fs->next_clst, fat_fs->last_clst + 1);
+	if (clst == 0)
+		clst = fat_scan_free (fat_fs->data_start, fat_fs->next_clst);
+	ASSERT (clst != 0);
+
+	fat_fs->next_clst = clst < fat_fs->last_clst ? clst + 1 : fat_fs->data_start;
+	return clst;
+}
+
+/* Returns the first free cluster at or after START and before
+ * END, or 0 if there is none.  A cluster whose FAT sector has not
+ * been read only looks free, so the sector is read to make sure. */
+static cluster_t
+fat_scan_free (cluster_t start, cluster_t end) {
+	while (start < end) {
+		size_t clst = bitmap_scan (fat_fs->free_map, start, 1, false);
+		if (clst == BITMAP_ERROR || clst >= end)
+			break;
+		fat_load (clst / FAT_PER_SECTOR);
+		if (!bitmap_test (fat_fs->free_map, clst))
+			return clst;
+		start = clst + 1;
+	}
+	return 0;
+}
+
+/* Returns the first cluster of the first run of at least CNT free
+ * clusters that starts at or after START and before END, or 0 if
+ * there is none. */
+static cluster_t
+fat_find_run (cluster_t start, cluster_t end, size_t cnt) {
+	while (start < end) {
+		cluster_t first = fat_scan_free (start, end);
+		if (first == 0)
+			break;
+		size_t used = bitmap_scan (fat_fs->free_map, first, 1, true);
+		if (used == BITMAP_ERROR)
+			used = fat_fs->last_clst + 1;
+		if (used - first >= cnt) {
+			/* Read the rest of the run's FAT sectors and look again
+			 * if that turned up clusters in use. */
+			if (!fat_load_range (first, first + cnt))
+				return first;
+			continue;
+		}
+		start = used;
+	}
+	return 0;
+}
+
 /*----------------------------------------------------------------------------*/
 /* FAT handling                                                               */
 /*----------------------------------------------------------------------------*/
@@ -220,30 +511,64 @@ fat_create_chain (cluster_t clst) {
 	// return cid;
 	// printf("create chain %d\n", clst);
 
-	cluster_t free_cluster = fat_fs->data_start;
-	while(fat_get(free_cluster) != 0 && free_cluster <= fat_fs->last_clst ){
-		// printf("fat_get %d %d\n", free_cluster, fat_get(free_cluster));
-		// if(free_cluster%1000==0){
-		// 	printf("move forward %d %d\n",free_cluster, fat_get(free_cluster));
+	cluster_t free_cluster = fat_allocate_run (1, clst);
+	if (free_cluster != 0 && clst != 0)
+		fat_put (clst, free_cluster);
 
-		// }
-		free_cluster++;
-	}
+	// printf("link to %d\n", free_cluster);
+	return free_cluster;
+}
+
+/* Allocate a chain of CNT clusters, physically contiguous if there
+ * is a long enough run of free clusters, and as close after HINT
+ * as possible.  If there is no such run, the chain is made of the
+ * free clusters that follow HINT, in order.  The caller links the
+ * chain to whatever it extends.
+ * Returns the first cluster of the chain, or 0 if fewer than CNT
+ * clusters are free, in which case nothing is allocated. */
+cluster_t
+fat_allocate_run (size_t cnt, cluster_t hint) {
+	cluster_t start, first, clst, prev;
+	size_t i;
 
-	if(free_cluster > fat_fs->last_clst){
+	ASSERT (cnt > 0);
+
+	lock_acquire (&fat_fs->write_lock);
+	if (fat_fs->free_cnt < cnt) {
+		lock_release (&fat_fs->write_lock);
 		return 0;
 	}
-	
-	if(clst==0){
-		fat_put(free_cluster, EOChain);
+
+	if (hint >= fat_fs->data_start && hint < fat_fs->last_clst)
+		start = hint + 1;
+	else
+		start = fat_fs->next_clst;
+	first = fat_find_run (start, fat_fs->last_clst + 1, cnt);
+	if (first == 0)
+		first = fat_find_run (fat_fs->data_start, start, cnt);
+
+	if (first != 0) {
+		for (i = 0; i < cnt; i++)
+			fat_put (first + i, i + 1 < cnt ? first + i + 1 : EOChain);
+		fat_fs->next_clst = first + cnt <= fat_fs->last_clst
+			? first + cnt : fat_fs->data_start;
 	} else {
-		fat_put(clst, free_cluster);
-		fat_put(free_cluster, EOChain);
+		/* Free space is too fragmented.  Take clusters in order from
+		 * START, which keeps the chain in as few pieces as it can. */
+		fat_fs->next_clst = start;
+		prev = 0;
+		for (i = 0; i < cnt; i++) {
+			clst = fat_find_free ();
+			fat_put (clst, EOChain);
+			if (prev != 0)
+				fat_put (prev, clst);
+			else
+				first = clst;
+			prev = clst;
+		}
 	}
-
-	// printf("link to %d\n", free_cluster);
-	return free_cluster;
-
+	lock_release (&fat_fs->write_lock);
+	return first;
 }
 
 /* Remove the chain of clusters starting from CLST.
@@ -267,6 +592,7 @@ fat_remove_chain (cluster_t clst, cluster_t pclst) {
 	// }
 
 	// printf("remove chain %d %d\n", clst, pclst);
+	lock_acquire (&fat_fs->write_lock);
 	if(pclst != 0){
 		fat_put(pclst, EOChain);
 	}
@@ -278,15 +604,31 @@ fat_remove_chain (cluster_t clst, cluster_t pclst) {
 		fat_put(nclst, 0);
 		nclst = tmp_clst;
 	}
+	lock_release (&fat_fs->write_lock);
 
 }
 
-/* Update a value in the FAT table. */
+/* Update a value in the FAT table, keeping the free map in step
+ * with it once there is one. */
 void
 fat_put (cluster_t clst, cluster_t val) {
 	/* TODO: Your code goes here. */
 	// *(fat_fs->fat + clst) = val;
+	fat_load (clst / FAT_PER_SECTOR);
+	if (fat_fs->free_map != NULL && clst >= fat_fs->data_start
+			&& clst <= fat_fs->last_clst) {
+		bool used = val != 0;
+		if (bitmap_test (fat_fs->free_map, clst) != used) {
+			bitmap_set (fat_fs->free_map, clst, used);
+			if (used)
+				fat_fs->free_cnt--;
+			else
+				fat_fs->free_cnt++;
+		}
+	}
 	fat_fs->fat[clst] = val;
+	if (fat_fs->dirty_map != NULL)
+		bitmap_mark (fat_fs->dirty_map, clst / FAT_PER_SECTOR);
 }
 
 /* Fetch a value in the FAT table. */
@@ -294,20 +636,28 @@ cluster_t
 fat_get (cluster_t clst) {
 	/* TODO: Your code goes here. */
 	// return *(fat_fs->fat + clst);
+	fat_load (clst / FAT_PER_SECTOR);
 	return fat_fs->fat[clst];
 }
 
-/* Covert a cluster # to a sector number. */
+/* Returns the number of sectors in a cluster. */
+unsigned int
+fat_cluster_sectors (void) {
+	return fat_fs->bs.sectors_per_cluster;
+}
+
+/* Covert a cluster # to the number of its first sector. */
 disk_sector_t
 cluster_to_sector (cluster_t clst) {
 	/* TODO: Your code goes here. */
 	// return fat_fs->fat_length + clst + 1;
-	return clst;
+	return clst * fat_fs->bs.sectors_per_cluster;
 }
 
+/* Converts a sector number to the # of the cluster it is in. */
 cluster_t
 sector_to_cluster (disk_sector_t sec) {
 	/* TODO: Your code goes here. */
 	// return sec - fat_fs->fat_length - 1;
-	return sec;
+	return sec / fat_fs->bs.sectors_per_cluster;
 }
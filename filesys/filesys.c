@@ -1,14 +1,22 @@
 #include "filesys/filesys.h"
 #include <debug.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/directory.h"
 #include "devices/disk.h"
+#include "devices/timer.h"
 #include "filesys/fat.h"
 #include "filesys/inode.h"
+#include "filesys/page_cache.h"
+#include <round.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "intrinsic.h"
 
 
 /* The disk that contains the file system. */
@@ -18,209 +26,779 @@ static void do_format (void);
 
 struct buffer_cache *buffer_cache;
 
-//unsigned int buffer_flush_count;
-
+/* Write-behind parameters of the flusher thread. */
+#define BUFFER_FLUSH_INTERVAL (30 * TIMER_FREQ) /* Max age of dirty data, in ticks. */
+#define BUFFER_FLUSH_POLL (TIMER_FREQ / 10)     /* Flusher wake-up period, in ticks. */
+
+/* Maximum number of contiguous dirty sectors written back by one
+ * disk_writev() call. */
+#define BUFFER_WRITEBACK_MAX 32
+
+/* Buffer cache statistics.  Kept outside BUFFER_CACHE so that
+ * they can still be printed after buffer_cache_close().  Updated
+ * under BUFFER_CACHE->LOCK. */
+static struct fsstat buffer_cache_stats;
+
+/* -bc: Size of the buffer cache in megabytes.
+ * 0 selects BUFFER_CACHE_DEFAULT_SIZE sectors. */
+size_t buffer_cache_mb;
+
+static uint64_t buffer_cache_hash (const struct hash_elem *, void *);
+static bool buffer_cache_less (const struct hash_elem *,
+		const struct hash_elem *, void *);
+static struct buffer_cache_entry *buffer_cache_find (disk_sector_t);
+static struct buffer_cache_entry *buffer_cache_lookup (disk_sector_t);
+static struct buffer_cache_entry *buffer_cache_alloc (disk_sector_t);
+static struct buffer_cache_entry *buffer_cache_evict (bool ghost_frequent);
+static struct buffer_cache_entry *buffer_cache_victim (struct list *);
+static uint64_t buffer_cache_ghost_hash (const struct hash_elem *, void *);
+static bool buffer_cache_ghost_less (const struct hash_elem *,
+		const struct hash_elem *, void *);
+static struct buffer_cache_ghost *buffer_cache_ghost_find (disk_sector_t);
+static void buffer_cache_ghost_add (disk_sector_t, bool frequent);
+static void buffer_cache_ghost_remove (struct buffer_cache_ghost *);
+static struct buffer_cache_entry *buffer_cache_get (disk_sector_t, bool read);
+static void buffer_cache_put (struct buffer_cache_entry *, bool dirty);
+static size_t buffer_cache_writeback (disk_sector_t first, bool wait);
+static void buffer_cache_flusher (void *);
+static void buffer_cache_readaheadd (void *);
+
+/* A sector waiting to be prefetched by the read-ahead thread. */
+struct readahead_entry {
+	struct list_elem elem;
+	disk_sector_t sector;
+};
+
+/* Initializes the buffer cache.  Every slot starts out on the
+ * free list; slots holding a sector are indexed by sector number
+ * in SECTOR_MAP, so that a lookup does not have to scan the whole
+ * cache.
+ * Replacement follows ARC (Megiddo and Modha, FAST '03).  Cached
+ * slots are on T1 if they were referenced once and on T2 if they
+ * were referenced again while cached.  B1 and B2 remember the
+ * sectors most recently evicted from each, and a miss on one of
+ * those ghosts moves TARGET, the share of the cache given to T1,
+ * toward the list that would have kept it.  A sequential scan thus
+ * only recycles T1 and leaves the hot metadata on T2 alone.
+ * The sector data of all slots lives in one run of contiguous
+ * pages, sized by the -bc option.
+ * Dirty slots are written behind by a flusher thread, and
+ * read-ahead requests are served by a second thread.
+ *
+ * Synchronization is two-level.  BUFFER_CACHE->LOCK protects the
+ * index, the lists and the per-slot metadata and is never held
+ * across disk I/O.  Each slot's own LOCK is held by whoever uses or
+ * fills its data, so a thread waiting for one sector to come off
+ * disk only blocks threads that want that same sector.  A slot
+ * with a nonzero PIN_CNT is in use and never chosen for eviction. */
 void
 buffer_cache_init(void) {
 	unsigned int t;
 	buffer_cache = calloc(1, sizeof(struct buffer_cache));
-	buffer_cache->buffer_cache_size = 64;
+	if (buffer_cache == NULL)
+		PANIC ("buffer cache init failed");
+	if (buffer_cache_mb > 0)
+		buffer_cache->buffer_cache_size =
+			buffer_cache_mb * (1024 * 1024 / DISK_SECTOR_SIZE);
+	else
+		buffer_cache->buffer_cache_size = BUFFER_CACHE_DEFAULT_SIZE;
+	buffer_cache->data_pages =
+		DIV_ROUND_UP (buffer_cache->buffer_cache_size * DISK_SECTOR_SIZE, PGSIZE);
+	buffer_cache->data = palloc_get_multiple (PAL_ZERO, buffer_cache->data_pages);
+	if (buffer_cache->data == NULL)
+		PANIC ("buffer cache init failed: cannot allocate %zu pages",
+				buffer_cache->data_pages);
 	buffer_cache->buffer_array = (struct buffer_cache_entry *) calloc(buffer_cache->buffer_cache_size, sizeof(struct buffer_cache_entry));
-	//buffer_cache->lock = (struct lock *) calloc(1,sizeof(struct lock));
-	//lock_init(buffer_cache->lock);
-	//buffer_read_lock = (struct lock *) calloc(1,sizeof(struct lock));
-	//buffer_write_lock = (struct lock *) calloc(1,sizeof(struct lock));
-	buffer_lock = (struct lock *) calloc(1,sizeof(struct lock));
-	buffer_evict_lock = (struct lock *) calloc(1,sizeof(struct lock));
-	//lock_init(buffer_read_lock);
-	//lock_init(buffer_write_lock);
-	lock_init(buffer_lock);
-	lock_init(buffer_evict_lock);
+	if (buffer_cache->buffer_array == NULL
+			|| !hash_init (&buffer_cache->sector_map, buffer_cache_hash,
+				buffer_cache_less, NULL))
+		PANIC ("buffer cache init failed");
+	list_init (&buffer_cache->free_list);
+	list_init (&buffer_cache->t1);
+	list_init (&buffer_cache->t2);
+	list_init (&buffer_cache->b1);
+	list_init (&buffer_cache->b2);
+	list_init (&buffer_cache->ghost_free);
+	lock_init (&buffer_cache->lock);
+
+	/* B1 and B2 together never remember more sectors than the
+	 * cache holds. */
+	buffer_cache->ghost_array = calloc (buffer_cache->buffer_cache_size,
+			sizeof *buffer_cache->ghost_array);
+	if (buffer_cache->ghost_array == NULL
+			|| !hash_init (&buffer_cache->ghost_map, buffer_cache_ghost_hash,
+				buffer_cache_ghost_less, NULL))
+		PANIC ("buffer cache init failed");
+	for (t = 0; t < buffer_cache->buffer_cache_size; t++)
+		list_push_back (&buffer_cache->ghost_free,
+				&buffer_cache->ghost_array[t].elem);
+
 	for(t=0; t < buffer_cache->buffer_cache_size; t++){
-		buffer_cache->buffer_array[t].dirty_bit = 0;
-		buffer_cache->buffer_array[t].sector = -1;
-		buffer_cache->buffer_array[t].clock_bit = 0;
-		buffer_cache->buffer_array[t].buffer = calloc(1, DISK_SECTOR_SIZE);
+		struct buffer_cache_entry *b = &buffer_cache->buffer_array[t];
+		b->dirty_bit = 0;
+		b->sector = -1;
+		lock_init (&b->lock);
+		b->buffer = buffer_cache->data + t * DISK_SECTOR_SIZE;
+		list_push_back (&buffer_cache->free_list, &b->lru_elem);
 	}
-	//buffer_flush_count = 0;
+
+	list_init (&buffer_cache->ra_queue);
+	lock_init (&buffer_cache->ra_lock);
+	sema_init (&buffer_cache->ra_wait, 0);
+
+	sema_init (&buffer_cache->daemon_done, 0);
+	if (thread_create ("bc_flusher", PRI_DEFAULT, buffer_cache_flusher,
+				NULL) == TID_ERROR
+			|| thread_create ("bc_readahead", PRI_DEFAULT,
+				buffer_cache_readaheadd, NULL) == TID_ERROR)
+		PANIC ("buffer cache init failed: cannot start cache threads");
 }
 
 void
 buffer_cache_close(void) {
 	unsigned int t;
+
+	/* Stop the cache threads before tearing the cache down under
+	 * them. */
+	buffer_cache->closing = true;
+	sema_up (&buffer_cache->ra_wait);
+	sema_down (&buffer_cache->daemon_done);
+	sema_down (&buffer_cache->daemon_done);
+	while (!list_empty (&buffer_cache->ra_queue))
+		free (list_entry (list_pop_front (&buffer_cache->ra_queue),
+					struct readahead_entry, elem));
+
+	/* Write back in coalesced runs, then one by one whatever the
+	 * flush could not get to. */
+	buffer_cache_flush ();
 	for (t=0;t < buffer_cache->buffer_cache_size; t++){
-		if (buffer_cache->buffer_array[t].dirty_bit){
-			disk_write(filesys_disk, buffer_cache->buffer_array[t].sector, buffer_cache->buffer_array[t].buffer);
+		struct buffer_cache_entry *b = &buffer_cache->buffer_array[t];
+		if (b->sector != -1 && b->dirty_bit){
+			disk_write(filesys_disk, b->sector, b->buffer);
+			buffer_cache_stats.cache_writebacks++;
 		}
-		free(buffer_cache->buffer_array[t].buffer);
 	}
-	free(buffer_lock);
-	free(buffer_evict_lock);
+	hash_destroy (&buffer_cache->sector_map, NULL);
+	hash_destroy (&buffer_cache->ghost_map, NULL);
+	free (buffer_cache->ghost_array);
+	palloc_free_multiple (buffer_cache->data, buffer_cache->data_pages);
 	free(buffer_cache->buffer_array);
 	free(buffer_cache);
+	buffer_cache = NULL;
 }
 
-//void
-//buffer_flush(void){
-//  unsigned int t;
-// 	for (t=0;t < buffer_cache->buffer_cache_size; t++){
-// 		if (buffer_cache->buffer_array[t].dirty_bit){
-// 			disk_write(filesys_disk, buffer_cache->buffer_array[t].sector, buffer_cache->buffer_array[t].buffer);
-// 		}
-// 	}
-// 	for(t=0; t < buffer_cache->buffer_cache_size; t++){
-// 		buffer_cache->buffer_array[t].dirty_bit = 0;
-// 		buffer_cache->buffer_array[t].sector = -1;
-// 		buffer_cache->buffer_array[t].clock_bit = 0;
-// 		memset(buffer_cache->buffer_array[t].buffer, 0, DISK_SECTOR_SIZE);
-// 	}
-// 	buffer_flush_count = 0;
-// 	// buffer_cache_close();
-// 	// buffer_cache_init();
-//}
+/* Hash function for the sector index. */
+static uint64_t
+buffer_cache_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct buffer_cache_entry *b =
+		hash_entry (e, struct buffer_cache_entry, hash_elem);
+	return hash_bytes (&b->sector, sizeof b->sector);
+}
 
-void
-buffer_clock(void){
-	unsigned int t;
-	for(t=0; t < buffer_cache->buffer_cache_size; t++){
-		if (buffer_cache->buffer_array[t].sector != -1){
-			buffer_cache->buffer_array[t].clock_bit += 1;
+/* Orders entries of the sector index by sector number. */
+static bool
+buffer_cache_less (const struct hash_elem *a_, const struct hash_elem *b_,
+		void *aux UNUSED) {
+	const struct buffer_cache_entry *a =
+		hash_entry (a_, struct buffer_cache_entry, hash_elem);
+	const struct buffer_cache_entry *b =
+		hash_entry (b_, struct buffer_cache_entry, hash_elem);
+	return a->sector < b->sector;
+}
+
+/* Returns the slot caching SECTOR, or a null pointer if SECTOR is
+ * not cached. */
+static struct buffer_cache_entry *
+buffer_cache_find (disk_sector_t sector) {
+	struct buffer_cache_entry key;
+	struct hash_elem *e;
+
+	key.sector = sector;
+	e = hash_find (&buffer_cache->sector_map, &key.hash_elem);
+	return e != NULL ? hash_entry (e, struct buffer_cache_entry, hash_elem) : NULL;
+}
+
+/* Like buffer_cache_find(), but also records the reference: a hit
+ * on T1 promotes the slot to T2, and a hit on T2 makes it the most
+ * recently used there.  The first reference to a prefetched slot
+ * is its first real use, so it stays on T1; otherwise a sequential
+ * read of a big file would flood T2. */
+static struct buffer_cache_entry *
+buffer_cache_lookup (disk_sector_t sector) {
+	struct buffer_cache_entry *b = buffer_cache_find (sector);
+
+	if (b == NULL)
+		return NULL;
+	list_remove (&b->lru_elem);
+	if (b->prefetched){
+		b->prefetched = false;
+		buffer_cache_stats.ra_hits++;
+	} else if (!b->frequent){
+		b->frequent = true;
+		buffer_cache->t1_cnt--;
+		buffer_cache->t2_cnt++;
+	}
+	list_push_back (b->frequent ? &buffer_cache->t2 : &buffer_cache->t1,
+			&b->lru_elem);
+	return b;
+}
+
+/* Hash function for the ghost index. */
+static uint64_t
+buffer_cache_ghost_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct buffer_cache_ghost *g =
+		hash_entry (e, struct buffer_cache_ghost, hash_elem);
+	return hash_bytes (&g->sector, sizeof g->sector);
+}
+
+/* Orders entries of the ghost index by sector number. */
+static bool
+buffer_cache_ghost_less (const struct hash_elem *a_,
+		const struct hash_elem *b_, void *aux UNUSED) {
+	const struct buffer_cache_ghost *a =
+		hash_entry (a_, struct buffer_cache_ghost, hash_elem);
+	const struct buffer_cache_ghost *b =
+		hash_entry (b_, struct buffer_cache_ghost, hash_elem);
+	return a->sector < b->sector;
+}
+
+/* Returns the ghost of SECTOR on B1 or B2, or a null pointer if
+ * there is none. */
+static struct buffer_cache_ghost *
+buffer_cache_ghost_find (disk_sector_t sector) {
+	struct buffer_cache_ghost key;
+	struct hash_elem *e;
+
+	key.sector = sector;
+	e = hash_find (&buffer_cache->ghost_map, &key.hash_elem);
+	return e != NULL ? hash_entry (e, struct buffer_cache_ghost, hash_elem) : NULL;
+}
+
+/* Forgets ghost G. */
+static void
+buffer_cache_ghost_remove (struct buffer_cache_ghost *g) {
+	list_remove (&g->elem);
+	hash_delete (&buffer_cache->ghost_map, &g->hash_elem);
+	if (g->frequent)
+		buffer_cache->b2_cnt--;
+	else
+		buffer_cache->b1_cnt--;
+	list_push_back (&buffer_cache->ghost_free, &g->elem);
+}
+
+/* Remembers SECTOR, just evicted from T2 if FREQUENT is true or
+ * from T1 otherwise, as the most recent ghost on B2 or B1.  Keeps
+ * T1 plus B1 within the cache size, and drops the oldest ghost
+ * when all are in use. */
+static void
+buffer_cache_ghost_add (disk_sector_t sector, bool frequent) {
+	size_t size = buffer_cache->buffer_cache_size;
+	struct buffer_cache_ghost *g;
+
+	if (!frequent && buffer_cache->b1_cnt > 0
+			&& buffer_cache->t1_cnt + buffer_cache->b1_cnt >= size)
+		buffer_cache_ghost_remove (list_entry (list_front (&buffer_cache->b1),
+					struct buffer_cache_ghost, elem));
+	if (list_empty (&buffer_cache->ghost_free)){
+		struct list *l = !list_empty (&buffer_cache->b2)
+			? &buffer_cache->b2 : &buffer_cache->b1;
+		buffer_cache_ghost_remove (list_entry (list_front (l),
+					struct buffer_cache_ghost, elem));
+	}
+
+	g = list_entry (list_pop_front (&buffer_cache->ghost_free),
+			struct buffer_cache_ghost, elem);
+	g->sector = sector;
+	g->frequent = frequent;
+	hash_insert (&buffer_cache->ghost_map, &g->hash_elem);
+	if (frequent){
+		list_push_back (&buffer_cache->b2, &g->elem);
+		buffer_cache->b2_cnt++;
+	} else {
+		list_push_back (&buffer_cache->b1, &g->elem);
+		buffer_cache->b1_cnt++;
+	}
+}
+
+/* Takes a slot for SECTOR, from the free list if possible or else
+ * by evicting one, and indexes it as the most recently used slot
+ * of T1, or of T2 if SECTOR was found on a ghost list.  The slot's
+ * contents are unspecified.
+ * Returns a null pointer if BUFFER_CACHE->LOCK had to be dropped
+ * to make room, in which case SECTOR may have been cached by
+ * someone else meanwhile and the caller must look it up again. */
+static struct buffer_cache_entry *
+buffer_cache_alloc (disk_sector_t sector) {
+	struct buffer_cache_entry *b;
+	struct buffer_cache_ghost *g;
+
+	ASSERT (lock_held_by_current_thread (&buffer_cache->lock));
+
+	g = buffer_cache_ghost_find (sector);
+	if (!list_empty (&buffer_cache->free_list))
+		b = list_entry (list_pop_front (&buffer_cache->free_list),
+				struct buffer_cache_entry, lru_elem);
+	else if ((b = buffer_cache_evict (g != NULL && g->frequent)) == NULL)
+		return NULL;
+
+	/* Evicting may have pushed SECTOR's ghost out. */
+	g = buffer_cache_ghost_find (sector);
+	b->frequent = g != NULL;
+	if (g != NULL){
+		/* A ghost hit on B1 means T1 was too small, one on B2 that
+		 * T2 was.  Shift TARGET by the ratio of the ghost lists. */
+		size_t size = buffer_cache->buffer_cache_size;
+		size_t delta;
+
+		if (!g->frequent){
+			delta = buffer_cache->b2_cnt / buffer_cache->b1_cnt;
+			if (delta < 1)
+				delta = 1;
+			buffer_cache->target = buffer_cache->target + delta < size
+				? buffer_cache->target + delta : size;
+		} else {
+			delta = buffer_cache->b1_cnt / buffer_cache->b2_cnt;
+			if (delta < 1)
+				delta = 1;
+			buffer_cache->target = buffer_cache->target > delta
+				? buffer_cache->target - delta : 0;
 		}
+		buffer_cache_ghost_remove (g);
+	}
+
+	b->sector = sector;
+	b->dirty_bit = 0;
+	b->prefetched = false;
+	hash_insert (&buffer_cache->sector_map, &b->hash_elem);
+	if (b->frequent){
+		list_push_back (&buffer_cache->t2, &b->lru_elem);
+		buffer_cache->t2_cnt++;
+	} else {
+		list_push_back (&buffer_cache->t1, &b->lru_elem);
+		buffer_cache->t1_cnt++;
 	}
-//	buffer_flush_count += 1;
+	return b;
 }
 
-void
-buffer_cache_read(disk_sector_t sector_idx, void *buffer) {
-	// printf("buffer_cache_read\n");
-	//if (buffer_flush_count >= 1000){
-	//	//printf("flush\n");
-	//	buffer_flush();
-	//}
-	//if (sector_idx == 2000){
-	//	printf("thread %d read\n", thread_current()->tid);
-	//}
-	//lock_acquire(buffer_cache->lock);
-	//printf("thread read :%d, sector num:%d\n", thread_current()->tid, sector_idx);
-	unsigned int t;
-	int bufferindex = -1;
-	int newwriteindex = -1;
-	for(t=0; t < buffer_cache->buffer_cache_size; t++){
-		struct buffer_cache_entry a = buffer_cache->buffer_array[t];
-		if (a.sector == sector_idx){
-			bufferindex = t;
-			break;
+/* Returns the least recently used slot on LIST that is not
+ * pinned, or a null pointer if there is none. */
+static struct buffer_cache_entry *
+buffer_cache_victim (struct list *list) {
+	struct list_elem *e;
+
+	for (e = list_begin (list); e != list_end (list); e = list_next (e)){
+		struct buffer_cache_entry *b =
+			list_entry (e, struct buffer_cache_entry, lru_elem);
+		if (b->pin_cnt == 0)
+			return b;
+	}
+	return NULL;
+}
+
+/* Evicts a slot that is not pinned and returns it unlinked from
+ * the sector index and from T1 or T2, leaving its sector behind as
+ * a ghost.  The victim comes from T1 while T1 is above TARGET, or
+ * at TARGET if the sector being loaded was a ghost on B2
+ * (GHOST_FREQUENT), and from T2 otherwise.
+ * A dirty victim is written back first.  Since that drops
+ * BUFFER_CACHE->LOCK, this function then returns a null pointer
+ * instead, as it also does when every slot is pinned; see
+ * buffer_cache_alloc(). */
+static struct buffer_cache_entry *
+buffer_cache_evict(bool ghost_frequent){
+	struct buffer_cache_entry *b;
+	bool from_t1 = buffer_cache->t1_cnt > 0
+		&& (buffer_cache->t1_cnt > buffer_cache->target
+				|| (ghost_frequent && buffer_cache->t1_cnt == buffer_cache->target));
+
+	b = buffer_cache_victim (from_t1 ? &buffer_cache->t1 : &buffer_cache->t2);
+	if (b == NULL)
+		b = buffer_cache_victim (from_t1 ? &buffer_cache->t2 : &buffer_cache->t1);
+	if (b == NULL){
+		lock_release (&buffer_cache->lock);
+		thread_yield ();
+		lock_acquire (&buffer_cache->lock);
+		return NULL;
+	}
+
+	if (b->dirty_bit != 0){
+		/* Take the dirty sectors that follow the victim along. */
+		disk_sector_t sector = b->sector;
+
+		lock_release (&buffer_cache->lock);
+		buffer_cache_writeback (sector, false);
+		lock_acquire (&buffer_cache->lock);
+		return NULL;
+	}
+
+	list_remove (&b->lru_elem);
+	if (b->frequent)
+		buffer_cache->t2_cnt--;
+	else
+		buffer_cache->t1_cnt--;
+	/* A prefetched sector that was never used says nothing about
+	 * the workload, so it leaves no ghost. */
+	if (b->prefetched)
+		buffer_cache_stats.ra_unused++;
+	else
+		buffer_cache_ghost_add (b->sector, b->frequent);
+	buffer_cache_stats.cache_evictions++;
+	hash_delete (&buffer_cache->sector_map, &b->hash_elem);
+	b->sector = -1;
+	return b;
+}
+
+/* Returns the slot for SECTOR pinned and with its lock held,
+ * loading it on a miss.  If READ is false the caller is about to
+ * overwrite the whole sector, so a miss skips the disk read.
+ * Release the slot with buffer_cache_put(). */
+static struct buffer_cache_entry *
+buffer_cache_get (disk_sector_t sector, bool read) {
+	struct buffer_cache_entry *b;
+
+	lock_acquire (&buffer_cache->lock);
+	for (;;){
+		b = buffer_cache_lookup (sector);
+		if (b != NULL){
+			/* Hit.  If the slot is still being loaded, its lock is
+			 * held until the data is there. */
+			buffer_cache_stats.cache_hits++;
+			b->pin_cnt++;
+			lock_release (&buffer_cache->lock);
+			lock_acquire (&b->lock);
+			b->hold_start = rdtsc ();
+			return b;
 		}
+		b = buffer_cache_alloc (sector);
+		if (b != NULL)
+			break;
 	}
-	for(t=0; t < buffer_cache->buffer_cache_size; t++){
-		struct buffer_cache_entry a = buffer_cache->buffer_array[t];
-		if (a.sector == -1){
-			newwriteindex = t;
+
+	/* Miss.  Nobody else can hold the fresh slot's lock, so taking
+	 * it under BUFFER_CACHE->LOCK does not block. */
+	buffer_cache_stats.cache_misses++;
+	b->pin_cnt++;
+	lock_acquire (&b->lock);
+	b->hold_start = rdtsc ();
+	lock_release (&buffer_cache->lock);
+	if (read)
+		disk_read(filesys_disk, sector, b->buffer);
+	return b;
+}
+
+/* Releases slot B obtained from buffer_cache_get(), marking it
+ * dirty if DIRTY is true. */
+static void
+buffer_cache_put (struct buffer_cache_entry *b, bool dirty) {
+	lock_acquire (&buffer_cache->lock);
+	if (dirty && !b->dirty_bit){
+		b->dirty_bit = 1;
+		buffer_cache->dirty_cnt++;
+	}
+	buffer_cache_stats.hold_cnt++;
+	buffer_cache_stats.hold_cycles += rdtsc () - b->hold_start;
+	lock_release (&b->lock);
+	b->pin_cnt--;
+	lock_release (&buffer_cache->lock);
+}
+
+/* Writes back the dirty slot caching sector FIRST together with
+ * the dirty slots caching the sectors right after it, up to
+ * BUFFER_WRITEBACK_MAX in all, with a single disk_writev().
+ * If WAIT is true and FIRST's slot is in use, waits for it;
+ * otherwise in-use slots end the run.  Returns the number of
+ * sectors written, which is 0 if FIRST is not cached dirty.
+ *
+ * Only FIRST's slot lock is ever waited for.  The others are
+ * merely tried, since their holder may itself be waiting for a
+ * slot locked here, e.g. while faulting in the user page it is
+ * copying to. */
+static size_t
+buffer_cache_writeback (disk_sector_t first, bool wait) {
+	struct buffer_cache_entry *run[BUFFER_WRITEBACK_MAX];
+	const void *buffers[BUFFER_WRITEBACK_MAX];
+	size_t cnt = 0, locked, i;
+
+	lock_acquire (&buffer_cache->lock);
+	while (cnt < BUFFER_WRITEBACK_MAX){
+		struct buffer_cache_entry *b = buffer_cache_find (first + cnt);
+
+		if (b == NULL || !b->dirty_bit
+				|| (b->pin_cnt > 0 && (cnt > 0 || !wait)))
 			break;
-		}
+		b->pin_cnt++;
+		run[cnt++] = b;
+	}
+	lock_release (&buffer_cache->lock);
+	if (cnt == 0)
+		return 0;
+
+	lock_acquire (&run[0]->lock);
+	run[0]->hold_start = rdtsc ();
+	for (locked = 1; locked < cnt; locked++){
+		if (!lock_try_acquire (&run[locked]->lock))
+			break;
+		run[locked]->hold_start = rdtsc ();
 	}
 
-	if (bufferindex != -1){
-		memcpy(buffer, buffer_cache->buffer_array[bufferindex].buffer, DISK_SECTOR_SIZE);
-		buffer_clock();
-		buffer_cache->buffer_array[bufferindex].clock_bit = 0;
-		// return;
-	}else{
-		if (newwriteindex == -1){
-			lock_acquire(buffer_evict_lock);
-			newwriteindex = buffer_cache_evict();
-			lock_release(buffer_evict_lock);
+	/* Clean slots cannot differ from the disk, so one that was
+	 * written back by someone else meanwhile may go out again. */
+	lock_acquire (&buffer_cache->lock);
+	for (i = locked; i < cnt; i++)
+		run[i]->pin_cnt--;
+	for (i = 0; i < locked; i++){
+		if (run[i]->dirty_bit){
+			run[i]->dirty_bit = 0;
+			buffer_cache->dirty_cnt--;
+			buffer_cache_stats.cache_writebacks++;
 		}
-		disk_read(filesys_disk, sector_idx, buffer_cache->buffer_array[newwriteindex].buffer);
-		buffer_clock();
-		buffer_cache->buffer_array[newwriteindex].clock_bit = 0;
-		buffer_cache->buffer_array[newwriteindex].sector = sector_idx;
-		buffer_cache->buffer_array[newwriteindex].dirty_bit = 0;
-		memcpy(buffer, buffer_cache->buffer_array[newwriteindex].buffer, DISK_SECTOR_SIZE);
-		// return;
+		buffers[i] = run[i]->buffer;
 	}
-	//printf("thread read finish :%d, sector num:%d\n", thread_current()->tid, sector_idx);
-	//lock_release(buffer_cache->lock);
+	lock_release (&buffer_cache->lock);
+
+	disk_writev (filesys_disk, first, buffers, locked);
+	for (i = 0; i < locked; i++)
+		buffer_cache_put (run[i], false);
+	return locked;
 }
 
-unsigned int
-buffer_cache_evict(void){
-	// printf("buffer_cache_evict\n");
-	unsigned int t;
-	int bufferindex = 0;
-	int max_clock = 0;
-	for(t=0; t < buffer_cache->buffer_cache_size; t++){
-		struct buffer_cache_entry a = buffer_cache->buffer_array[t];
-		if(a.clock_bit > max_clock){
-			max_clock = a.clock_bit;
-			bufferindex = t;
+/* Pins the cached copy of SECTOR and returns a pointer to its
+ * DISK_SECTOR_SIZE bytes, which the caller may read and, if it
+ * passes true to buffer_cache_unpin(), modify in place.  If READ is
+ * false the caller is going to overwrite the whole sector and a
+ * miss does not read it from disk.  The slot stays locked until it
+ * is unpinned, so do not pin a sector twice at once. */
+void *
+buffer_cache_pin (disk_sector_t sector, bool read) {
+	return buffer_cache_get (sector, read)->buffer;
+}
+
+/* Unpins the sector whose data DATA points to, as returned by
+ * buffer_cache_pin().  Marks it dirty if DIRTY is true. */
+void
+buffer_cache_unpin (const void *data, bool dirty) {
+	size_t idx = ((const uint8_t *) data - buffer_cache->data) / DISK_SECTOR_SIZE;
+
+	ASSERT (idx < buffer_cache->buffer_cache_size);
+	buffer_cache_put (&buffer_cache->buffer_array[idx], dirty);
+}
+
+void
+buffer_cache_read(disk_sector_t sector_idx, void *buffer) {
+	void *data = buffer_cache_pin (sector_idx, true);
+
+	memcpy(buffer, data, DISK_SECTOR_SIZE);
+	buffer_cache_unpin (data, false);
+}
+
+bool
+buffer_cache_write(disk_sector_t sector_idx, const void *buffer){
+	void *data = buffer_cache_pin (sector_idx, false);
+
+	memcpy(data, buffer, DISK_SECTOR_SIZE);
+	buffer_cache_unpin (data, true);
+	return true;
+}
+
+/* Drops the cached copy of SECTOR, if any, without writing it
+ * back.  The page cache calls this before it reads a sector
+ * itself, since the sector may have held a directory or inode
+ * before it was freed and reused for file data. */
+void
+buffer_cache_discard (disk_sector_t sector) {
+	struct buffer_cache_entry *b;
+
+	lock_acquire (&buffer_cache->lock);
+	while ((b = buffer_cache_find (sector)) != NULL){
+		/* The copy is stale either way, so it must never be written
+		 * over what the page cache puts in the sector. */
+		if (b->dirty_bit){
+			b->dirty_bit = 0;
+			buffer_cache->dirty_cnt--;
+		}
+		if (b->pin_cnt == 0){
+			list_remove (&b->lru_elem);
+			if (b->frequent)
+				buffer_cache->t2_cnt--;
+			else
+				buffer_cache->t1_cnt--;
+			hash_delete (&buffer_cache->sector_map, &b->hash_elem);
+			b->sector = -1;
+			list_push_back (&buffer_cache->free_list, &b->lru_elem);
+			break;
 		}
-		// printf("index: %d, clock: %d\n",t,a.clock_bit);
+
+		/* Wait for whoever is using or loading the slot, then look
+		 * again, since someone may have pinned it meanwhile. */
+		b->pin_cnt++;
+		lock_release (&buffer_cache->lock);
+		lock_acquire (&b->lock);
+		lock_acquire (&buffer_cache->lock);
+		lock_release (&b->lock);
+		b->pin_cnt--;
+	}
+	lock_release (&buffer_cache->lock);
+}
+
+/* Orders disk_sector_t values for qsort(). */
+static int
+compare_sectors (const void *a_, const void *b_) {
+	const disk_sector_t *a = a_;
+	const disk_sector_t *b = b_;
+	return *a < *b ? -1 : *a > *b;
+}
+
+/* Writes every dirty slot back to disk in ascending sector order,
+ * coalescing contiguous sectors into one disk command.  Only one
+ * run of slots is locked at a time, so foreground accesses can
+ * interleave with a long flush. */
+void
+buffer_cache_flush (void) {
+	disk_sector_t *sectors;
+	size_t cnt = 0, i;
+
+	lock_acquire (&buffer_cache->lock);
+	if (buffer_cache->dirty_cnt == 0
+			|| (sectors = malloc (buffer_cache->dirty_cnt * sizeof *sectors)) == NULL) {
+		lock_release (&buffer_cache->lock);
+		return;
 	}
-	//if (buffer_cache->buffer_array[bufferindex].sector == 2000){
-	//	printf("thread %d evict\n", thread_current()->tid);
-	//}
+	for (i = 0; i < buffer_cache->buffer_cache_size && cnt < buffer_cache->dirty_cnt; i++){
+		struct buffer_cache_entry *b = &buffer_cache->buffer_array[i];
+		if (b->sector != -1 && b->dirty_bit)
+			sectors[cnt++] = b->sector;
+	}
+	lock_release (&buffer_cache->lock);
+
+	qsort (sectors, cnt, sizeof *sectors, compare_sectors);
+	for (i = 0; i < cnt; ){
+		disk_sector_t first = sectors[i];
+		size_t written = buffer_cache_writeback (first, true);
 
-	if (buffer_cache->buffer_array[bufferindex].dirty_bit != 0){
-		//printf("sector num: %d\n", buffer_cache->buffer_array[bufferindex].sector);
-		disk_write(filesys_disk, buffer_cache->buffer_array[bufferindex].sector, buffer_cache->buffer_array[bufferindex].buffer);
+		/* Skip the sectors that went out with FIRST. */
+		do
+			i++;
+		while (i < cnt && sectors[i] < first + written);
 	}
-	buffer_cache->buffer_array[bufferindex].sector = -1;
-	buffer_cache->buffer_array[bufferindex].dirty_bit = 0;
-	memset(buffer_cache->buffer_array[bufferindex].buffer, 0, DISK_SECTOR_SIZE);
-	buffer_cache->buffer_array[bufferindex].clock_bit = 0;
-	// printf("evict buffer index: %d\n", bufferindex);
-	
-	return bufferindex;
+	free (sectors);
 }
 
-bool
-buffer_cache_write(disk_sector_t sector_idx, void* buffer){
-	//printf("buffer_cache_write\n");
-	//if (sector_idx == 2000){
-	//	printf("thread %d write\n", thread_current()->tid);
-	//}
-	//printf("thread write :%d, sector num: %d\n", thread_current()->tid, sector_idx);
-	//lock_acquire(buffer_cache->lock);
-	unsigned int t;
-	int bufferindex = -1;
-	int newwriteindex = -1;
-	for(t=0; t < buffer_cache->buffer_cache_size; t++){
-		struct buffer_cache_entry a = buffer_cache->buffer_array[t];
-		if (a.sector == sector_idx){
-			bufferindex = t;
-			break;
+/* Flusher thread.  Writes dirty slots back every
+ * BUFFER_FLUSH_INTERVAL ticks, or sooner once half of the cache is
+ * dirty, so that eviction usually finds clean victims and a crash
+ * loses a bounded amount of data.  The FAT sectors changed since
+ * the last flush follow the data they describe. */
+static void
+buffer_cache_flusher (void *aux UNUSED) {
+	int64_t last_flush = timer_ticks ();
+
+	while (!buffer_cache->closing){
+		timer_sleep (BUFFER_FLUSH_POLL);
+		if (buffer_cache->dirty_cnt >= buffer_cache->buffer_cache_size / 2
+				|| timer_elapsed (last_flush) >= BUFFER_FLUSH_INTERVAL){
+			buffer_cache_flush ();
+#ifdef EFILESYS
+			fat_flush ();
+#endif
+			last_flush = timer_ticks ();
 		}
 	}
-	for(t=0; t < buffer_cache->buffer_cache_size; t++){
-		struct buffer_cache_entry a = buffer_cache->buffer_array[t];
-		if (a.sector == -1){
-			newwriteindex = t;
+	sema_up (&buffer_cache->daemon_done);
+}
+
+
+/* Queues SECTOR to be read into the cache in the background.
+ * Does nothing if too many requests are already pending. */
+void
+buffer_cache_readahead (disk_sector_t sector) {
+	struct readahead_entry *ra;
+
+	if (buffer_cache->ra_pending >= buffer_cache->buffer_cache_size / 2)
+		return;
+	ra = malloc (sizeof *ra);
+	if (ra == NULL)
+		return;
+	ra->sector = sector;
+
+	lock_acquire (&buffer_cache->ra_lock);
+	list_push_back (&buffer_cache->ra_queue, &ra->elem);
+	buffer_cache->ra_pending++;
+	lock_release (&buffer_cache->ra_lock);
+	sema_up (&buffer_cache->ra_wait);
+}
+
+/* Read-ahead thread.  Loads queued sectors that are not cached
+ * yet, marking them as prefetched so that buffer_cache_lookup()
+ * and buffer_cache_evict() can tell whether the prefetch was
+ * used. */
+static void
+buffer_cache_readaheadd (void *aux UNUSED) {
+	for (;;){
+		struct readahead_entry *ra;
+		struct buffer_cache_entry *b;
+
+		sema_down (&buffer_cache->ra_wait);
+		if (buffer_cache->closing)
 			break;
+
+		lock_acquire (&buffer_cache->ra_lock);
+		ra = list_entry (list_pop_front (&buffer_cache->ra_queue),
+				struct readahead_entry, elem);
+		buffer_cache->ra_pending--;
+		lock_release (&buffer_cache->ra_lock);
+
+		/* Give up on the sector rather than wait if it is cached
+		 * already or no slot is free right away. */
+		lock_acquire (&buffer_cache->lock);
+		if (buffer_cache_find (ra->sector) != NULL
+				|| (b = buffer_cache_alloc (ra->sector)) == NULL){
+			lock_release (&buffer_cache->lock);
+			free (ra);
+			continue;
 		}
+		b->prefetched = true;
+		b->pin_cnt++;
+		buffer_cache_stats.ra_issued++;
+		lock_acquire (&b->lock);
+		b->hold_start = rdtsc ();
+		lock_release (&buffer_cache->lock);
+
+		disk_read(filesys_disk, ra->sector, b->buffer);
+		buffer_cache_put (b, false);
+		free (ra);
 	}
+	sema_up (&buffer_cache->daemon_done);
+}
 
-	if(bufferindex != -1){
-		memcpy(buffer_cache->buffer_array[bufferindex].buffer, buffer, DISK_SECTOR_SIZE);
-		buffer_clock();
-		buffer_cache->buffer_array[bufferindex].dirty_bit = 1;
-		buffer_cache->buffer_array[bufferindex].clock_bit = 0;
-	}else{
-		if (newwriteindex == -1){
-			lock_acquire(buffer_evict_lock);
-			newwriteindex = buffer_cache_evict();
-			lock_release(buffer_evict_lock);
-		}
-		memcpy(buffer_cache->buffer_array[newwriteindex].buffer, buffer, DISK_SECTOR_SIZE);
-		buffer_clock();
-		buffer_cache->buffer_array[newwriteindex].sector = sector_idx;
-		buffer_cache->buffer_array[newwriteindex].dirty_bit = 1;
-		buffer_cache->buffer_array[newwriteindex].clock_bit = 0;
+/* Stores the buffer cache and file system disk statistics
+ * gathered so far into ST. */
+void
+buffer_cache_get_stats (struct fsstat *st) {
+	if (buffer_cache != NULL)
+		lock_acquire (&buffer_cache->lock);
+	*st = buffer_cache_stats;
+	if (buffer_cache != NULL)
+		lock_release (&buffer_cache->lock);
+	if (filesys_disk != NULL){
+		st->disk_reads = disk_read_cnt (filesys_disk);
+		st->disk_writes = disk_write_cnt (filesys_disk);
 	}
-	//printf("thread write finish :%d, sector num: %d\n", thread_current()->tid, sector_idx);
-	//lock_release(buffer_cache->lock);
 }
 
+/* Prints buffer cache statistics. */
+void
+buffer_cache_print_stats (void) {
+	const struct fsstat *st = &buffer_cache_stats;
+
+	printf ("Buffer cache: %lld hits, %lld misses, %lld evictions, "
+			"%lld writebacks\n", st->cache_hits, st->cache_misses,
+			st->cache_evictions, st->cache_writebacks);
+	printf ("Read-ahead: %lld issued, %lld hits, %lld unused\n",
+			st->ra_issued, st->ra_hits, st->ra_unused);
+	if (st->hold_cnt > 0)
+		printf ("Buffer cache: %lld cycles average slot hold time\n",
+				st->hold_cycles / st->hold_cnt);
+}
 
 /* Initializes the file system module.
  * If FORMAT is true, reformats the file system. */
@@ -235,11 +813,13 @@ filesys_init (bool format) {
 #ifdef EFILESYS
 	fat_init ();
 	buffer_cache_init();
+	pagecache_init ();
 
 	if (format)
 		do_format ();
 
 	fat_open ();
+	thread_current ()->cur_sector = cluster_to_sector (ROOT_DIR_CLUSTER);
 
 	struct dir *dir = dir_open_root();
 	// printf("dir inode sector %d\n", dir->inode->sector);
@@ -265,8 +845,10 @@ void
 filesys_done (void) {
 	/* Original FS */
 #ifdef EFILESYS
+	page_cache_done ();
 	fat_close ();
 	buffer_cache_close();
+	disk_flush (filesys_disk);
 #else
 	free_map_close ();
 #endif
@@ -102,7 +102,7 @@ fsutil_put (char **argv) {
 		PANIC ("%s: missing PUT signature on scratch disk", file_name);
 	size = ((int32_t *) buffer)[1];
 	if (size < 0)
-		PANIC ("%s: invalid file size %d", file_name, size);
+		PANIC ("%s: invalid file size %lld", file_name, (long long) size);
 
 	/* Create destination file. */
 	if (!filesys_create (file_name, size))
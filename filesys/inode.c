@@ -6,11 +6,20 @@
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#include "threads/vaddr.h"
 #include "filesys/fat.h"
+#include "filesys/page_cache.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* Bounds of the read-ahead window, in sectors. */
+#define READAHEAD_MIN 4
+#define READAHEAD_MAX 64
+
+/* Sectors of zeros written at a time to new files. */
+#define ZERO_SECTORS 8
+
 
 /* Returns the number of sectors to allocate for an inode SIZE
  * bytes long. */
@@ -19,33 +28,285 @@ bytes_to_sectors (off_t size) {
 	return DIV_ROUND_UP (size, DISK_SECTOR_SIZE);
 }
 
+/* Returns the number of bytes in a cluster. */
+static inline off_t
+cluster_size (void) {
+	return fat_cluster_sectors () * DISK_SECTOR_SIZE;
+}
+
+/* Returns the number of clusters to allocate for an inode SIZE
+ * bytes long. */
+static inline size_t
+bytes_to_clusters (off_t size) {
+	return DIV_ROUND_UP (size, cluster_size ());
+}
+
+/* Appends disk cluster CLST to INODE's cluster map, growing it
+ * as needed.  Returns false if out of memory. */
+static bool
+clst_map_push (struct inode *inode, cluster_t clst) {
+	if (inode->clst_cnt == inode->clst_cap) {
+		size_t cap = inode->clst_cap > 0 ? inode->clst_cap * 2 : 8;
+		cluster_t *map = realloc (inode->clst_map, cap * sizeof *map);
+		if (map == NULL)
+			return false;
+		inode->clst_map = map;
+		inode->clst_cap = cap;
+	}
+	inode->clst_map[inode->clst_cnt++] = clst;
+	return true;
+}
+
+/* Data clusters are chained in the FAT as always, but an inode
+ * whose HAS_EXTENTS is set also lists them as extents, so that
+ * mapping its offsets takes no FAT reads.  The first INODE_EXTENTS
+ * extents are in the inode, and up to EXTENT_BLOCK_EXTENTS more in
+ * the first sector of a cluster of their own.  An extent that
+ * starts at cluster 0 is a hole: its clusters are not allocated and
+ * read as zeros, and the FAT chain holds only the clusters that
+ * are, in file order.  A file without holes that grows too
+ * fragmented for its extents drops them and is mapped by the FAT
+ * chain alone, as are inodes written before extents existed. */
+
+/* Most extents an inode can have. */
+#define MAX_EXTENTS (INODE_EXTENTS + EXTENT_BLOCK_EXTENTS)
+
+/* Stores extent I of DISK in *E. */
+static void
+extent_get (const struct inode_disk *disk, size_t i, struct inode_extent *e) {
+	if (i < INODE_EXTENTS)
+		*e = disk->extents[i];
+	else {
+		const struct inode_extent *block =
+			buffer_cache_pin (disk->extent_block, true);
+		*e = block[i - INODE_EXTENTS];
+		buffer_cache_unpin (block, false);
+	}
+}
+
+/* Sets extent I of DISK to *E. */
+static void
+extent_set (struct inode_disk *disk, size_t i, const struct inode_extent *e) {
+	if (i < INODE_EXTENTS)
+		disk->extents[i] = *e;
+	else {
+		struct inode_extent *block = buffer_cache_pin (disk->extent_block, true);
+		block[i - INODE_EXTENTS] = *e;
+		buffer_cache_unpin (block, true);
+	}
+}
+
+/* Makes sure DISK has room for CNT extents, allocating its extent
+ * block if they do not all fit in the inode.  Returns false if
+ * that is impossible. */
+static bool
+extent_reserve (struct inode_disk *disk, size_t cnt) {
+	cluster_t block;
+	void *data;
+
+	if (cnt > MAX_EXTENTS)
+		return false;
+	if (cnt <= INODE_EXTENTS || disk->extent_block != 0)
+		return true;
+
+	block = fat_create_chain (0);
+	if (block == 0)
+		return false;
+	disk->extent_block = cluster_to_sector (block);
+	data = buffer_cache_pin (disk->extent_block, false);
+	memset (data, 0, DISK_SECTOR_SIZE);
+	buffer_cache_unpin (data, true);
+	return true;
+}
+
+/* Adds CNT clusters starting at CLST, or a hole of CNT clusters if
+ * CLST is 0, to the end of DISK's extents, growing the last extent
+ * if they continue it.  Returns false if there is no room for
+ * another extent. */
+static bool
+extent_append (struct inode_disk *disk, cluster_t clst, size_t cnt) {
+	struct inode_extent e;
+
+	if (disk->extent_cnt > 0) {
+		extent_get (disk, disk->extent_cnt - 1, &e);
+		if (e.start == 0 ? clst == 0 : clst == e.start + e.cnt) {
+			e.cnt += cnt;
+			extent_set (disk, disk->extent_cnt - 1, &e);
+			return true;
+		}
+	}
+
+	if (!extent_reserve (disk, disk->extent_cnt + 1))
+		return false;
+	e.start = clst;
+	e.cnt = cnt;
+	extent_set (disk, disk->extent_cnt++, &e);
+	return true;
+}
+
+/* Returns true if DISK's extents include a hole. */
+static bool
+extent_has_holes (const struct inode_disk *disk) {
+	struct inode_extent e;
+	size_t i;
+
+	for (i = 0; i < disk->extent_cnt; i++) {
+		extent_get (disk, i, &e);
+		if (e.start == 0)
+			return true;
+	}
+	return false;
+}
+
+/* Returns the cluster that holds file cluster IDX according to
+ * DISK's extents, or 0 if it is in a hole or past the end. */
+static cluster_t
+extent_lookup (const struct inode_disk *disk, size_t idx) {
+	struct inode_extent e;
+	size_t i;
+
+	for (i = 0; i < disk->extent_cnt; i++) {
+		extent_get (disk, i, &e);
+		if (idx < e.cnt)
+			return e.start != 0 ? e.start + idx : 0;
+		idx -= e.cnt;
+	}
+	return 0;
+}
+
+/* Stops DISK's data from being mapped by extents, and frees its
+ * extent block.  Unless the inode is being removed, DISK must not
+ * have holes, which only the extents record. */
+static void
+extent_drop (struct inode_disk *disk) {
+	if (disk->extent_block != 0)
+		fat_remove_chain (sector_to_cluster (disk->extent_block), 0);
+	disk->extent_block = 0;
+	disk->extent_cnt = 0;
+	disk->has_extents = false;
+}
+
+/* Adds the clusters of the chain that starts at CLST to DISK's
+ * extents, dropping the extents if they run out of room. */
+static void
+extent_append_chain (struct inode_disk *disk, cluster_t clst) {
+	for (; disk->has_extents && clst != EOChain; clst = fat_get (clst))
+		if (!extent_append (disk, clst, 1))
+			extent_drop (disk);
+}
+
+/* Rewrites INODE's extents from its complete cluster map.  Returns
+ * false, leaving them as they were, if they do not fit. */
+static bool
+extent_rebuild (struct inode *inode) {
+	struct inode_extent e;
+	size_t i, cnt = 0;
+
+	for (i = 0; i < inode->clst_cnt; i++)
+		if (i == 0 || (inode->clst_map[i] == 0
+					? inode->clst_map[i - 1] != 0
+					: inode->clst_map[i] != inode->clst_map[i - 1] + 1))
+			cnt++;
+	if (!extent_reserve (&inode->data, cnt))
+		return false;
+
+	inode->data.extent_cnt = 0;
+	for (i = 0; i < inode->clst_cnt; i += e.cnt) {
+		e.start = inode->clst_map[i];
+		for (e.cnt = 1; i + e.cnt < inode->clst_cnt
+				&& inode->clst_map[i + e.cnt]
+				== (e.start != 0 ? e.start + e.cnt : 0); e.cnt++)
+			continue;
+		extent_set (&inode->data, inode->data.extent_cnt++, &e);
+	}
+	return true;
+}
+
+/* Fills INODE's cluster map from its extents.  Stops short if out
+ * of memory. */
+static void
+clst_map_fill_extents (struct inode *inode) {
+	struct inode_extent e;
+	size_t i, j;
+
+	inode->clst_cnt = 0;
+	for (i = 0; i < inode->data.extent_cnt; i++) {
+		extent_get (&inode->data, i, &e);
+		for (j = 0; j < e.cnt; j++)
+			if (!clst_map_push (inode, e.start != 0 ? e.start + j : 0))
+				return;
+	}
+	inode->clst_end = true;
+}
+
+/* Fills in INODE's cluster map until it covers file cluster IDX or
+ * the end of the file: from the extents if INODE has them, in full,
+ * and otherwise by walking the FAT chain on from the last cluster
+ * in the map.  Stops short if out of memory. */
+static void
+clst_map_fill (struct inode *inode, size_t idx) {
+	ASSERT (lock_held_by_current_thread (&inode->clst_lock));
+
+	if (inode->data.has_extents) {
+		if (!inode->clst_end)
+			clst_map_fill_extents (inode);
+		return;
+	}
+	while (inode->clst_cnt <= idx && !inode->clst_end) {
+		cluster_t next = inode->clst_cnt == 0 ? inode->data.start
+			: fat_get (inode->clst_map[inode->clst_cnt - 1]);
+		if (next == 0 || next == EOChain)
+			inode->clst_end = true;
+		else if (!clst_map_push (inode, next))
+			break;
+	}
+}
+
+#ifdef EFILESYS
+/* Returns the disk cluster that holds file cluster IDX of INODE,
+ * or 0 if it is in a hole or past the end.  Each link of the chain
+ * is followed only once; later lookups come from the cluster map. */
+static cluster_t
+inode_cluster (struct inode *inode, size_t idx) {
+	cluster_t c;
+	size_t i;
+
+	lock_acquire (&inode->clst_lock);
+	clst_map_fill (inode, idx);
+	if (idx < inode->clst_cnt)
+		c = inode->clst_map[idx];
+	else if (inode->clst_end)
+		c = 0;
+	else if (inode->data.has_extents)
+		c = extent_lookup (&inode->data, idx);
+	else {
+		/* No memory to map further, so walk the rest. */
+		i = inode->clst_cnt;
+		c = i == 0 ? inode->data.start : fat_get (inode->clst_map[i - 1]);
+		for (; i < idx && c != 0 && c != EOChain; i++)
+			c = fat_get (c);
+		if (c == EOChain)
+			c = 0;
+	}
+	lock_release (&inode->clst_lock);
+	return c;
+}
+#endif
+
 /* Returns the disk sector that contains byte offset POS within
  * INODE.
  * Returns -1 if INODE does not contain data for a byte at offset
  * POS. */
 static disk_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) {
+byte_to_sector (struct inode *inode, off_t pos) {
 #ifdef EFILESYS
 	ASSERT (inode != NULL);
 	if (pos < inode->data.length){
-		cluster_t c = inode->data.start;
-		// printf("byte to sector %d\n", inode->sector);
-		// printf("cstart %d %d %d\n", c, pos, inode->data.length);
-		while(pos >= DISK_SECTOR_SIZE){
-			if(c==EOChain){
-				// printf("cc %d\n", c);
-				return -1;
-			}
-			c = fat_get(c);
-			pos -= DISK_SECTOR_SIZE;
-		}
-		// printf("c %d\n", c);
-		disk_sector_t s = cluster_to_sector(c);
-		// printf("s %d\n", s);
-		if(c == EOChain || c==0){
+		off_t csize = cluster_size ();
+		cluster_t c = inode_cluster (inode, pos / csize);
+		if (c == 0)
 			return -1;
-		}
-		return s;
+		return cluster_to_sector (c) + pos % csize / DISK_SECTOR_SIZE;
 	} else {
 		return -1;
 	}
@@ -58,6 +319,35 @@ byte_to_sector (const struct inode *inode, off_t pos) {
 #endif
 }
 
+/* Returns the disk sector that contains byte offset POS within
+ * INODE, or -1 if there is none. */
+disk_sector_t
+inode_byte_to_sector (struct inode *inode, off_t pos) {
+	return byte_to_sector (inode, pos);
+}
+
+#ifdef EFILESYS
+/* Returns true if INODE's data goes through the page cache.  That
+ * is only the case for regular files; directories and symbolic
+ * links, like inodes themselves, stay in the buffer cache. */
+bool
+inode_uses_page_cache (const struct inode *inode) {
+	return !inode->data.is_directory && !inode->data.is_symlink;
+}
+
+/* Returns true if a chunk at OFFSET in INODE is a new access to
+ * its page rather than a continuation of the last one, and makes
+ * the page the last one accessed. */
+static bool
+inode_page_accessed (struct inode *inode, off_t offset) {
+	off_t page = ROUND_DOWN (offset, PGSIZE);
+	bool accessed = page != inode->pc_last;
+
+	inode->pc_last = page;
+	return accessed;
+}
+#endif
+
 /* List of open inodes, so that opening a single inode twice
  * returns the same `struct inode'. */
 static struct list open_inodes;
@@ -68,6 +358,197 @@ inode_init (void) {
 	list_init (&open_inodes);
 }
 
+/* Writes zeros to the CNT clusters of the chain that starts at
+ * CLST, a run of contiguous sectors at a time.  Any cached copy of
+ * a sector is stale, since it was freed and reused, and is dropped
+ * first. */
+static void
+zero_chain (cluster_t clst, size_t cnt) {
+	static char zeros[ZERO_SECTORS * DISK_SECTOR_SIZE];
+	const size_t spc = fat_cluster_sectors ();
+
+	while (cnt > 0) {
+		cluster_t start = clst;
+		size_t run = 0, sectors, i, j, n;
+
+		do {
+			clst = fat_get (clst);
+			run++;
+		} while (run < cnt && clst == start + run);
+		cnt -= run;
+
+		sectors = run * spc;
+		for (i = 0; i < sectors; i += n) {
+			n = sectors - i < ZERO_SECTORS ? sectors - i : ZERO_SECTORS;
+			for (j = 0; j < n; j++)
+				buffer_cache_discard (cluster_to_sector (start) + i + j);
+			disk_write_multi (filesys_disk, cluster_to_sector (start) + i,
+					zeros, n);
+		}
+	}
+}
+
+/* Allocates the clusters of the holes in file clusters FROM up to
+ * TO, exclusive, of INODE, whose cluster map must be complete, and
+ * zeros them.  A hole that cannot be split for lack of extents is
+ * filled whole.  Returns false if the disk is full or the extents
+ * do not fit, leaving the rest of the holes alone. */
+static bool
+inode_fill_holes (struct inode *inode, size_t from, size_t to) {
+	cluster_t *map = inode->clst_map;
+	size_t a, b, hole_start, hole_end, i;
+
+	for (a = from; a < to; a = b) {
+		cluster_t prev = 0, next, run, tail, c;
+
+		if (map[a] != 0) {
+			b = a + 1;
+			continue;
+		}
+		for (b = a; b < to && map[b] == 0; b++)
+			continue;
+		for (hole_start = a; hole_start > 0 && map[hole_start - 1] == 0; hole_start--)
+			continue;
+		for (hole_end = b; hole_end < inode->clst_cnt && map[hole_end] == 0; hole_end++)
+			continue;
+		if (inode->data.extent_cnt + (a > hole_start) + (b < hole_end) > MAX_EXTENTS) {
+			a = hole_start;
+			b = hole_end;
+		}
+
+		/* Allocate near the cluster before the hole, which the new
+		 * clusters follow in the FAT chain. */
+		for (i = a; i > 0 && prev == 0; i--)
+			prev = map[i - 1];
+		next = prev != 0 ? fat_get (prev)
+			: inode->data.start != 0 ? inode->data.start : EOChain;
+		run = fat_allocate_run (b - a, prev);
+		if (run == 0)
+			return false;
+		zero_chain (run, b - a);
+		for (i = a, c = run; i < b; i++, c = fat_get (c))
+			map[i] = tail = c;
+		fat_put (tail, next);
+		if (prev != 0)
+			fat_put (prev, run);
+		else
+			inode->data.start = run;
+
+		if (!extent_rebuild (inode)) {
+			for (i = a; i < b; i++)
+				map[i] = 0;
+			if (prev != 0)
+				fat_put (prev, next);
+			else
+				inode->data.start = next != EOChain ? next : 0;
+			fat_put (tail, EOChain);
+			fat_remove_chain (run, 0);
+			return false;
+		}
+	}
+	return true;
+}
+
+/* Returns true if INODE, whose last allocated cluster is LAST, has
+ * room in its extents for the clusters of RUN, after a hole first
+ * if HOLE is true. */
+static bool
+inode_extents_fit (struct inode *inode, cluster_t last, cluster_t run,
+		bool hole) {
+	size_t cnt = inode->data.extent_cnt + hole;
+	cluster_t prev = hole ? 0 : last, c;
+
+	for (c = run; c != EOChain; prev = c, c = fat_get (c))
+		if (prev == 0 || c != prev + 1)
+			cnt++;
+	return extent_reserve (&inode->data, cnt);
+}
+
+/* Allocates the clusters of INODE that bytes OFFSET up to LENGTH
+ * fall in, and makes INODE LENGTH bytes long if it is shorter.
+ * The holes in the range are filled, and the clusters past the end
+ * are allocated in one run that continues the last cluster if
+ * possible.  All of them are zeroed.  If INODE has extents, the
+ * clusters between its old end and OFFSET are left as a hole.
+ * Returns false if the disk is full, leaving the length as it was. */
+static bool
+inode_allocate (struct inode *inode, off_t offset, off_t length) {
+	size_t have, need = bytes_to_clusters (length);
+	size_t first = offset / cluster_size (), start, i;
+	cluster_t last = 0, c;
+	bool has_extents = inode->data.has_extents;
+	bool success = false;
+
+	lock_acquire (&inode->clst_lock);
+	clst_map_fill (inode, SIZE_MAX);
+	if (has_extents) {
+		if (!inode->clst_end)
+			goto done;
+		have = inode->clst_cnt;
+		for (i = have; i > 0 && last == 0; i--)
+			last = inode->clst_map[i - 1];
+		if (first < have
+				&& !inode_fill_holes (inode, first, need < have ? need : have))
+			goto done;
+	} else if (inode->clst_end) {
+		have = inode->clst_cnt;
+		last = have > 0 ? inode->clst_map[have - 1] : 0;
+	} else {
+		/* The map is short of memory: find the tail the slow way. */
+		have = 0;
+		for (c = inode->data.start; c != 0 && c != EOChain; c = fat_get (c)) {
+			last = c;
+			have++;
+		}
+	}
+
+	if (need > have) {
+		bool hole = has_extents && first > have
+			&& inode->data.extent_cnt + 2 <= MAX_EXTENTS;
+		cluster_t run;
+
+		start = hole ? first : have;
+		run = fat_allocate_run (need - start, last);
+		if (run == 0)
+			goto done;
+		if (has_extents && !inode_extents_fit (inode, last, run, hole)) {
+			/* Only a file without holes can do without extents. */
+			if (hole || extent_has_holes (&inode->data)) {
+				fat_remove_chain (run, 0);
+				goto done;
+			}
+			extent_drop (&inode->data);
+		}
+
+		/* The clusters held some other file's data, of which the
+		 * write may not cover every byte. */
+		zero_chain (run, need - start);
+		if (last == 0)
+			inode->data.start = run;
+		else
+			fat_put (last, run);
+		if (hole) {
+			extent_append (&inode->data, 0, first - have);
+			for (i = have; i < first && inode->clst_end; i++)
+				if (!clst_map_push (inode, 0))
+					inode->clst_end = false;
+		}
+		for (c = run; c != EOChain; c = fat_get (c)) {
+			if (inode->data.has_extents)
+				extent_append (&inode->data, c, 1);
+			if (inode->clst_end && !clst_map_push (inode, c))
+				inode->clst_end = false;
+		}
+	}
+	if (length > inode->data.length)
+		inode->data.length = length;
+	success = true;
+
+done:
+	lock_release (&inode->clst_lock);
+	return success;
+}
+
 /* Initializes an inode with LENGTH bytes of data and
  * writes the new inode to sector SECTOR on the file system
  * disk.
@@ -88,22 +569,22 @@ inode_create (disk_sector_t sector, off_t length, int symlink) {
 	// printf("inode creat %d %d\n", sector, length);
 	disk_inode = calloc (1, sizeof *disk_inode);
 	if (disk_inode != NULL) {
-		size_t sectors = bytes_to_sectors (length);
+		size_t clusters = bytes_to_clusters (length);
 		// printf("sectors %d\n", sectors);
 		disk_inode->length = length;
 		disk_inode->magic = INODE_MAGIC;
 		disk_inode->is_directory = 0;
-		cluster_t cid = 0;
-		if(sectors > 0){
-			cid = fat_create_chain(cid);
-			disk_inode->start = cid;
-			// printf("start %d\n", cid);
-			for(int j=1; j<sectors; j++){
-				cid = fat_create_chain(cid);
-				if(cid == 0){
-					return false;
-				}
+		disk_inode->has_extents = true;
+		if(clusters > 0){
+			/* Place the data right after the inode if there is room. */
+			disk_inode->start = fat_allocate_run (clusters,
+					sector_to_cluster (sector));
+			if (disk_inode->start == 0) {
+				free (disk_inode);
+				return false;
 			}
+			// printf("start %d\n", cid);
+			extent_append_chain (disk_inode, disk_inode->start);
 		}
 		if (symlink){
 			disk_inode->is_symlink = 1;
@@ -118,19 +599,8 @@ inode_create (disk_sector_t sector, off_t length, int symlink) {
 		//buffer_cache_write(sector, disk_inode);
 		//lock_release(buffer_lock);
 		disk_write (filesys_disk, sector, disk_inode);
-		if (sectors > 0) {
-			static char zeros[DISK_SECTOR_SIZE];
-			size_t i;
-			cluster_t c = disk_inode->start;
-			for (i = 0; i < sectors; i++) {
-				// printf("write on %d \n", cluster_to_sector(c));
-				//lock_acquire(buffer_lock);
-				//buffer_cache_write(cluster_to_sector(c), zeros);
-				//lock_release(buffer_lock);
-				disk_write (filesys_disk, cluster_to_sector(c), zeros); 
-				c = fat_get(c);
-			}
-		}
+		if (clusters > 0)
+			zero_chain (disk_inode->start, clusters);
 		success = true; 
 		free (disk_inode);
 	}	
@@ -200,9 +670,15 @@ inode_open (disk_sector_t sector) {
 	inode->open_cnt = 1;
 	inode->deny_write_cnt = 0;
 	inode->removed = false;
-	lock_acquire(buffer_lock);
+	inode->ra_next = 0;
+	inode->ra_end = 0;
+	inode->ra_window = 0;
+	inode->pc_last = -1;
+	inode->clst_map = NULL;
+	inode->clst_cnt = inode->clst_cap = 0;
+	inode->clst_end = false;
+	lock_init (&inode->clst_lock);
 	buffer_cache_read(inode->sector, &inode->data);
-	lock_release(buffer_lock);
 	// disk_read (filesys_disk, inode->sector, &inode->data);
 	// printf("open %d %d\n", sector, inode->sector);
 	// printf("inode data start %d\n", inode->data.start);
@@ -234,9 +710,7 @@ inode_close (struct inode *inode) {
 	if (inode == NULL)
 		return;
 	
-	lock_acquire(buffer_lock);
 	buffer_cache_write(inode->sector, &inode->data);
-	lock_release(buffer_lock);
 	// disk_write(filesys_disk, inode->sector, &inode->data);
 
 	// printf("inode close %d %d\n", inode->sector, inode->open_cnt - 1);
@@ -246,13 +720,17 @@ inode_close (struct inode *inode) {
 			
 			// fat_remove_chain(inode->sector, 0);
 			// printf("remove chain\n", inode->sector);
-			fat_remove_chain(inode->sector, 0);
-			fat_remove_chain(inode->data.start, 0);
+			page_cache_drop (inode);
+			fat_remove_chain(sector_to_cluster (inode->sector), 0);
+			/* An empty file, or one that starts with a hole, has no
+			 * chain, and cluster 0's entry must stay EOChain. */
+			if (inode->data.start != 0)
+				fat_remove_chain(inode->data.start, 0);
+			extent_drop (&inode->data);
 		}
-		lock_acquire(buffer_lock);
 		buffer_cache_write(inode->sector, &inode->data);
-		lock_release(buffer_lock);
 		// disk_write(filesys_disk, inode->sector, &inode->data);	
+		free (inode->clst_map);
 		free (inode); 
 	}
 
@@ -286,6 +764,57 @@ inode_remove (struct inode *inode) {
 	inode->removed = true;
 }
 
+/* Detects sequential reads of INODE and, for a read of SIZE bytes
+ * at OFFSET that continues the previous one, asks the page cache,
+ * or the buffer cache if INODE is not a regular file, to prefetch
+ * the data that follows it.  The window
+ * doubles on every sequential read, up to READAHEAD_MAX sectors,
+ * and collapses again on a seek. */
+static void
+inode_readahead (struct inode *inode, off_t offset, off_t size) {
+	off_t end = offset + size;
+	off_t ra_limit, pos;
+
+	if (offset != inode->ra_next) {
+		inode->ra_window = 0;
+		inode->ra_next = inode->ra_end = end;
+		return;
+	}
+	inode->ra_next = end;
+	if (inode->ra_window == 0)
+		inode->ra_window = READAHEAD_MIN;
+	else if (inode->ra_window < READAHEAD_MAX)
+		inode->ra_window *= 2;
+
+	ra_limit = end + inode->ra_window * DISK_SECTOR_SIZE;
+	if (ra_limit > inode_length (inode))
+		ra_limit = inode_length (inode);
+	pos = ROUND_DOWN (inode->ra_end > end ? inode->ra_end : end,
+			DISK_SECTOR_SIZE);
+	if (pos >= ra_limit)
+		return;
+
+#ifdef EFILESYS
+	if (inode_uses_page_cache (inode)) {
+		for (pos = ROUND_DOWN (pos, PGSIZE); pos < ra_limit; pos += PGSIZE)
+			page_cache_prefetch (inode, pos);
+		inode->ra_end = pos;
+		return;
+	}
+
+	for (; pos < ra_limit; pos += DISK_SECTOR_SIZE) {
+		disk_sector_t sector = byte_to_sector (inode, pos);
+		if (sector == (disk_sector_t) -1)
+			break;
+		buffer_cache_readahead (sector);
+	}
+#else
+	for (; pos < ra_limit; pos += DISK_SECTOR_SIZE)
+		buffer_cache_readahead (byte_to_sector (inode, pos));
+#endif
+	inode->ra_end = pos;
+}
+
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
  * Returns the number of bytes actually read, which may be less
  * than SIZE if an error occurs or end of file is reached. */
@@ -295,6 +824,9 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 	off_t bytes_read = 0;
 	uint8_t *bounce = NULL;
 
+	if (size > 0)
+		inode_readahead (inode, offset, size);
+
 	// printf("inode reat at %d %d %d\n", inode->sector, size, offset);
 
 	// printf("data start %d\n", inode->data.start);
@@ -303,9 +835,9 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 		/* Disk sector to read, starting byte offset within sector. */
 		disk_sector_t sector_idx = byte_to_sector (inode, offset);
 		// printf("sector %d\n", sector_idx);
-		if(sector_idx == -1 ) {
+		/* Past the end, or in a hole if short of the length. */
+		if (sector_idx == (disk_sector_t) -1 && offset >= inode_length (inode))
 			break;
-		}
 		int sector_ofs = offset % DISK_SECTOR_SIZE;
 
 		/* Bytes left in inode, bytes left in sector, lesser of the two. */
@@ -317,34 +849,42 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) {
 		if (chunk_size <= 0)
 			break;
 
-		if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
-			/* Read full sector directly into caller's buffer. */
-			lock_acquire(buffer_lock);
-			buffer_cache_read(sector_idx, buffer+bytes_read);
-			lock_release(buffer_lock);
-			// disk_read (filesys_disk, sector_idx, buffer + bytes_read); 
-		} else {
-			/* Read sector into bounce buffer, then partially copy
-			 * into caller's buffer. */
-			if (bounce == NULL) {
-				bounce = malloc (DISK_SECTOR_SIZE);
-				if (bounce == NULL)
+#ifdef EFILESYS
+		if (inode_uses_page_cache (inode)) {
+			bool accessed = inode_page_accessed (inode, offset);
+
+			/* Copy to a user buffer through BOUNCE, since a fault on
+			   it may need the very page whose lock is held while the
+			   data is copied out of the page cache. */
+			if (is_user_vaddr (buffer)) {
+				if (bounce == NULL
+						&& (bounce = malloc (DISK_SECTOR_SIZE)) == NULL)
 					break;
-			}
-			lock_acquire(buffer_lock);
-			buffer_cache_read(sector_idx, bounce);
-			lock_release(buffer_lock);
-			// disk_read (filesys_disk, sector_idx, bounce);
-			memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
+				page_cache_read (inode, bounce, offset, chunk_size, accessed);
+				memcpy (buffer + bytes_read, bounce, chunk_size);
+			} else
+				page_cache_read (inode, buffer + bytes_read, offset, chunk_size,
+						accessed);
+		} else
+#endif
+		if (sector_idx == (disk_sector_t) -1)
+			/* A hole reads as zeros. */
+			memset (buffer + bytes_read, 0, chunk_size);
+		else {
+			/* Copy the chunk straight out of the cached sector. */
+			uint8_t *data = buffer_cache_pin (sector_idx, true);
+			memcpy (buffer + bytes_read, data + sector_ofs, chunk_size);
+			buffer_cache_unpin (data, false);
 		}
+		// disk_read (filesys_disk, sector_idx, buffer + bytes_read); 
 
 		/* Advance. */
 		size -= chunk_size;
 		offset += chunk_size;
 		bytes_read += chunk_size;
 	}
-	free (bounce);
 	// printf("read done %d\n", bytes_read);
+	free (bounce);
 
 	return bytes_read;
 }
@@ -367,28 +907,11 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 	while (size > 0) {
 		/* Sector to write, starting byte offset within sector. */
 		disk_sector_t sector_idx = byte_to_sector (inode, offset);
-		cluster_t c;
-		while (sector_idx == -1){
-			inode->data.length = offset+size;
-			c = inode->data.start;
-			// printf("hey %d\n", c);
-			while ((fat_get(c) != EOChain) && (c != 0)){
-				c = fat_get(c);
-			}
-			c = fat_create_chain(c);
-			// printf("c %d %d\n",inode->data.start, c);
-			if(c == 0){
-				// printf("chain is 0\n");
+		if (sector_idx == -1) {
+			/* Allocate what the rest of the write needs at once. */
+			if (!inode_allocate (inode, offset, offset + size))
 				break;
-			}
-
-			if(inode->data.start == 0){
-				inode->data.start = c;
-			}
-			sector_idx = byte_to_sector(inode, offset);
-		}
-		if(c == 0){
-			break;
+			sector_idx = byte_to_sector (inode, offset);
 		}
 
 		int sector_ofs = offset % DISK_SECTOR_SIZE;
@@ -403,46 +926,42 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 		if (chunk_size <= 0)
 			break;
 
-		if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
-			/* Write full sector directly to disk. */
-			lock_acquire(buffer_lock);
-			buffer_cache_write(sector_idx, buffer+bytes_written);
-			lock_release(buffer_lock);
-			// disk_write (filesys_disk, sector_idx, buffer + bytes_written); 
-		} else {
-			/* We need a bounce buffer. */
-			if (bounce == NULL) {
-				bounce = malloc (DISK_SECTOR_SIZE);
-				if (bounce == NULL)
+#ifdef EFILESYS
+		if (inode_uses_page_cache (inode)) {
+			bool accessed = inode_page_accessed (inode, offset);
+
+			/* Copy from a user buffer through BOUNCE, for the same
+			   reason as in inode_read_at(). */
+			if (is_user_vaddr (buffer)) {
+				if (bounce == NULL
+						&& (bounce = malloc (DISK_SECTOR_SIZE)) == NULL)
 					break;
-			}
-
+				memcpy (bounce, buffer + bytes_written, chunk_size);
+				page_cache_write (inode, bounce, offset, chunk_size, accessed);
+			} else
+				page_cache_write (inode, buffer + bytes_written, offset,
+						chunk_size, accessed);
+		} else
+#endif
+		{
 			/* If the sector contains data before or after the chunk
-			   we're writing, then we need to read in the sector
-			   first.  Otherwise we start with a sector of all zeros. */
-			if (sector_ofs > 0 || chunk_size < sector_left){
-				lock_acquire(buffer_lock);
-				buffer_cache_read(sector_idx, bounce);
-				lock_release(buffer_lock);
-				// disk_read (filesys_disk, sector_idx, bounce);
-			}
-			else
-				memset (bounce, 0, DISK_SECTOR_SIZE);
-			memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-			lock_acquire(buffer_lock);
-			buffer_cache_write(sector_idx, bounce);
-			lock_release(buffer_lock);
-			// disk_write (filesys_disk, sector_idx, bounce); 
+			   we're writing, then the cached copy must be read in
+			   first.  Otherwise the chunk overwrites all of it. */
+			bool partial = sector_ofs > 0 || chunk_size < sector_left;
+			uint8_t *data = buffer_cache_pin (sector_idx, partial);
+			memcpy (data + sector_ofs, buffer + bytes_written, chunk_size);
+			buffer_cache_unpin (data, true);
 		}
+		// disk_write (filesys_disk, sector_idx, buffer + bytes_written); 
 
 		/* Advance. */
 		size -= chunk_size;
 		offset += chunk_size;
 		bytes_written += chunk_size;
 	}
-	free (bounce);
 
 	// printf("write done %d\n", bytes_written);
+	free (bounce);
 	return bytes_written;
 }
 
@@ -1,6 +1,18 @@
 /* page_cache.c: Implementation of Page Cache (Buffer Cache). */
 
 #include "vm/vm.h"
+#include <debug.h>
+#include <stdlib.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+#ifdef EFILESYS
 static bool page_cache_readahead (struct page *page, void *kva);
 static bool page_cache_writeback (struct page *page);
 static void page_cache_destroy (struct page *page);
@@ -15,36 +27,809 @@ static const struct page_operations page_cache_op = {
 
 tid_t page_cache_workerd;
 
+/* Regular file data is cached here in whole pages, one copy per
+ * file page, while directories and inodes stay in the sector
+ * buffer cache.  Both caches read and write the disk directly, so
+ * a sector must only ever be cached by one of them: a file's pages
+ * are dropped when the file is deleted, and filling a page discards
+ * whatever the buffer cache still holds for its sectors from their
+ * previous owner.
+ *
+ * Locking follows the buffer cache.  PAGE_CACHE_LOCK protects the
+ * index, the lists, the job queue and each page's key, sectors,
+ * valid and dirty bits and pin count, and is never held across
+ * disk I/O.  A page's own lock is held while its data is used or
+ * filled, and a pinned page is never evicted.
+ *
+ * So that one sequential scan cannot flush pages in repeated use,
+ * pages start on the inactive list and move to the active list
+ * when accessed again, and eviction takes inactive pages first.
+ * Callers tell repeated access apart from continuing through a
+ * page a chunk at a time, and the first access to a prefetched
+ * page does not count.
+ *
+ * A whole page of an mmap'd file maps the cached page itself into
+ * the process, so that the mapping and read() or write() see one
+ * copy.  A mapped page stays pinned until it is unmapped, and at
+ * most half of the cache is mapped at a time, so that the rest can
+ * still be recycled.  Stores through the mapping are not tracked,
+ * so unmapping a page that the process modified marks all of it
+ * dirty. */
+
+/* Number of pages in the cache if -pc is not given. */
+#define PAGE_CACHE_DEFAULT_PAGES 64
+
+/* Writeback parameters of the worker thread. */
+#define PAGE_CACHE_FLUSH_INTERVAL (30 * TIMER_FREQ) /* Max age of dirty data, in ticks. */
+#define PAGE_CACHE_POLL (TIMER_FREQ / 10)           /* Poll period while data is dirty, in ticks. */
+
+/* Bitmask of all sectors of a page. */
+#define ALL_SECTORS ((1 << PAGE_CACHE_SECTORS) - 1)
+
+/* A page that the worker thread is asked to read ahead. */
+struct page_cache_job {
+	struct list_elem elem;
+	disk_sector_t inode_sector;
+	off_t ofs;
+	disk_sector_t sectors[PAGE_CACHE_SECTORS];
+};
+
+/* -pc: Size of the page cache in megabytes.
+ * 0 selects PAGE_CACHE_DEFAULT_PAGES pages. */
+size_t page_cache_mb;
+
+static size_t max_pages;            /* Most pages the cache may hold. */
+static struct lock page_cache_lock;
+static struct hash page_map;        /* Cached pages, keyed by inode and offset. */
+static struct list inactive_list;   /* Pages accessed once, least recently
+                                       used first. */
+static struct list active_list;     /* Pages accessed again, least recently
+                                       used first. */
+static size_t active_cnt;           /* Number of elements in ACTIVE_LIST. */
+static struct list free_list;       /* Allocated pages not caching anything. */
+static size_t page_cnt;             /* Number of pages allocated. */
+static size_t share_cnt;            /* Mappings of pages into processes. */
+static size_t dirty_cnt;            /* Number of pages with dirty sectors. */
+static int64_t dirty_since;         /* When DIRTY_CNT last became nonzero. */
+static struct list job_queue;       /* Pending read-ahead jobs. */
+static size_t job_cnt;              /* Number of elements in JOB_QUEUE. */
+static struct semaphore job_wait;   /* Up'd when there is work. */
+static bool initialized;
+static bool closing;                /* Asks the worker thread to exit. */
+static struct semaphore worker_done;
+
+static void page_cache_kworkerd (void *aux);
+static uint64_t page_cache_hash (const struct hash_elem *, void *);
+static bool page_cache_less (const struct hash_elem *,
+		const struct hash_elem *, void *);
+static struct page *page_cache_find (disk_sector_t inode_sector, off_t ofs);
+static struct page *page_cache_alloc (bool wait);
+static struct page *page_cache_get (struct inode *, off_t ofs, bool accessed);
+static struct page *page_cache_victim (struct list *, bool wait);
+static void page_cache_put (struct page *, uint8_t dirty);
+static void page_cache_unlink (struct page *);
+static void page_cache_map (struct inode *, struct page *);
+static void page_cache_fill (struct page *, uint8_t mask);
+static int compare_pages (const void *, const void *);
+
 /* The initializer of file vm */
 void
 pagecache_init (void) {
-	/* TODO: Create a worker daemon for page cache with page_cache_kworkerd */
+	/* Called by both filesys_init() and vm_init(). */
+	if (initialized)
+		return;
+	initialized = true;
+
+	/* Pages are allocated as they are first needed. */
+	max_pages = page_cache_mb > 0 ? page_cache_mb * (1024 * 1024 / PGSIZE)
+		: PAGE_CACHE_DEFAULT_PAGES;
+	lock_init (&page_cache_lock);
+	if (!hash_init (&page_map, page_cache_hash, page_cache_less, NULL))
+		PANIC ("page cache init failed");
+	list_init (&inactive_list);
+	list_init (&active_list);
+	list_init (&free_list);
+	list_init (&job_queue);
+	sema_init (&job_wait, 0);
+	sema_init (&worker_done, 0);
+
+	page_cache_workerd = thread_create ("kworkerd", PRI_DEFAULT,
+			page_cache_kworkerd, NULL);
+	if (page_cache_workerd == TID_ERROR)
+		PANIC ("page cache init failed: cannot start kworkerd");
+}
+
+/* Stops the worker thread, writes back all dirty pages and frees
+ * the cache. */
+void
+page_cache_done (void) {
+	if (!initialized)
+		return;
+
+	closing = true;
+	sema_up (&job_wait);
+	sema_down (&worker_done);
+	while (!list_empty (&job_queue))
+		free (list_entry (list_pop_front (&job_queue),
+					struct page_cache_job, elem));
+
+	page_cache_flush ();
+	while (!list_empty (&inactive_list))
+		list_push_back (&free_list, list_pop_front (&inactive_list));
+	while (!list_empty (&active_list))
+		list_push_back (&free_list, list_pop_front (&active_list));
+	active_cnt = 0;
+	while (!list_empty (&free_list)){
+		struct page *page = list_entry (list_pop_front (&free_list),
+				struct page, page_cache.lru_elem);
+		destroy (page);
+		free (page);
+	}
+	hash_destroy (&page_map, NULL);
+	initialized = false;
 }
 
 /* Initialize the page cache */
 bool
-page_cache_initializer (struct page *page, enum vm_type type, void *kva) {
+page_cache_initializer (struct page *page, enum vm_type type UNUSED,
+		void *kva) {
+	struct page_cache *pc = &page->page_cache;
+
 	/* Set up the handler */
 	page->operations = &page_cache_op;
+	page->va = NULL;
+	page->frame->kva = kva;
 
+	pc->inode_sector = -1;
+	pc->ofs = 0;
+	memset (pc->sectors, 0xff, sizeof pc->sectors);
+	pc->valid = pc->dirty = 0;
+	lock_init (&pc->lock);
+	pc->pin_cnt = 0;
+	pc->active = pc->prefetched = false;
+	return true;
 }
 
 /* Utilze the Swap in mechanism to implement readhead */
 static bool
-page_cache_readahead (struct page *page, void *kva) {
+page_cache_readahead (struct page *page, void *kva UNUSED) {
+	/* The file may have been deleted, and its sectors reused,
+	 * since the read-ahead was requested. */
+	if (page->page_cache.inode_sector == (disk_sector_t) -1)
+		return false;
+	page_cache_fill (page, ALL_SECTORS);
+	return true;
 }
 
 /* Utilze the Swap out mechanism to implement writeback */
 static bool
 page_cache_writeback (struct page *page) {
+	struct page_cache *pc = &page->page_cache;
+	uint8_t *kva = page->frame->kva;
+	uint8_t dirty;
+	int i, j;
+
+	ASSERT (lock_held_by_current_thread (&pc->lock));
+
+	lock_acquire (&page_cache_lock);
+	dirty = pc->dirty;
+	if (dirty != 0){
+		pc->dirty = 0;
+		dirty_cnt--;
+	}
+	lock_release (&page_cache_lock);
+
+	/* Write each run of dirty sectors that are contiguous on disk
+	 * with one command. */
+	for (i = 0; i < PAGE_CACHE_SECTORS; i = j){
+		if (!(dirty & (1 << i))){
+			j = i + 1;
+			continue;
+		}
+		ASSERT (pc->sectors[i] != (disk_sector_t) -1);
+		for (j = i + 1; j < PAGE_CACHE_SECTORS && (dirty & (1 << j))
+				&& pc->sectors[j] == pc->sectors[i] + (j - i); j++)
+			continue;
+		disk_write_multi (filesys_disk, pc->sectors[i],
+				kva + i * DISK_SECTOR_SIZE, j - i);
+	}
+	return true;
 }
 
 /* Destory the page_cache. */
 static void
 page_cache_destroy (struct page *page) {
+	palloc_free_page (page->frame->kva);
+	free (page->frame);
 }
 
 /* Worker thread for page cache */
 static void
-page_cache_kworkerd (void *aux) {
+page_cache_kworkerd (void *aux UNUSED) {
+	for (;;){
+		struct page_cache_job *job;
+
+		/* Sleep until there is read-ahead work, polling instead
+		 * while dirty data waits for its writeback deadline.  Like
+		 * the buffer cache flusher, this polls coarsely; read-ahead
+		 * queued meanwhile waits for the next poll. */
+		if (dirty_cnt == 0)
+			sema_down (&job_wait);
+		else if (!sema_try_down (&job_wait))
+			timer_sleep (PAGE_CACHE_POLL);
+		if (closing)
+			break;
+
+		for (;;){
+			struct page *page;
+
+			lock_acquire (&page_cache_lock);
+			if (list_empty (&job_queue)){
+				lock_release (&page_cache_lock);
+				break;
+			}
+			job = list_entry (list_pop_front (&job_queue),
+					struct page_cache_job, elem);
+			job_cnt--;
+
+			/* Prefetch into a page nobody has touched yet, and
+			 * only if one is free without writing anything back. */
+			if (page_cache_find (job->inode_sector, job->ofs) != NULL
+					|| (page = page_cache_alloc (false)) == NULL){
+				lock_release (&page_cache_lock);
+				free (job);
+				continue;
+			}
+			page->page_cache.inode_sector = job->inode_sector;
+			page->page_cache.ofs = job->ofs;
+			memcpy (page->page_cache.sectors, job->sectors,
+					sizeof job->sectors);
+			hash_insert (&page_map, &page->page_cache.hash_elem);
+			page->page_cache.prefetched = true;
+			page->page_cache.pin_cnt++;
+			lock_acquire (&page->page_cache.lock);
+			lock_release (&page_cache_lock);
+
+			swap_in (page, page->frame->kva);
+			page_cache_put (page, 0);
+			free (job);
+		}
+
+		if (dirty_cnt >= max_pages / 2
+				|| (dirty_cnt > 0
+					&& timer_elapsed (dirty_since) >= PAGE_CACHE_FLUSH_INTERVAL))
+			page_cache_flush ();
+	}
+	sema_up (&worker_done);
+}
+
+/* Hash function for the page index. */
+static uint64_t
+page_cache_hash (const struct hash_elem *e, void *aux UNUSED) {
+	const struct page_cache *pc = hash_entry (e, struct page_cache, hash_elem);
+	uint64_t key = ((uint64_t) pc->inode_sector << 32)
+		^ (uint64_t) (pc->ofs / PGSIZE);
+	return hash_bytes (&key, sizeof key);
+}
+
+/* Orders entries of the page index by inode, then offset. */
+static bool
+page_cache_less (const struct hash_elem *a_, const struct hash_elem *b_,
+		void *aux UNUSED) {
+	const struct page_cache *a = hash_entry (a_, struct page_cache, hash_elem);
+	const struct page_cache *b = hash_entry (b_, struct page_cache, hash_elem);
+	if (a->inode_sector != b->inode_sector)
+		return a->inode_sector < b->inode_sector;
+	return a->ofs < b->ofs;
+}
+
+/* Returns the page caching offset OFS of the file whose inode is
+ * at INODE_SECTOR, or a null pointer if there is none. */
+static struct page *
+page_cache_find (disk_sector_t inode_sector, off_t ofs) {
+	struct page_cache key;
+	struct hash_elem *e;
+
+	key.inode_sector = inode_sector;
+	key.ofs = ofs;
+	e = hash_find (&page_map, &key.hash_elem);
+	return e != NULL ? hash_entry (e, struct page, page_cache.hash_elem) : NULL;
+}
+
+/* Returns the least recently used page on LIST that is not pinned,
+ * and not dirty unless WAIT is true, or a null pointer. */
+static struct page *
+page_cache_victim (struct list *list, bool wait) {
+	struct list_elem *e;
+
+	for (e = list_begin (list); e != list_end (list); e = list_next (e)){
+		struct page *page = list_entry (e, struct page, page_cache.lru_elem);
+		if (page->page_cache.pin_cnt == 0
+				&& (page->page_cache.dirty == 0 || wait))
+			return page;
+	}
+	return NULL;
+}
+
+/* Returns an unused page, as the most recently used inactive one,
+ * from the free list, by allocating a new page while there are
+ * fewer than MAX_PAGES, or else by evicting the least
+ * recently used page that is not pinned, inactive ones first.
+ * A dirty victim must be written back first.  If WAIT is true,
+ * this does so, dropping PAGE_CACHE_LOCK, and returns a null
+ * pointer to tell the caller to start over; otherwise dirty pages
+ * are skipped.  Also returns a null pointer if no page is
+ * available. */
+static struct page *
+page_cache_alloc (bool wait) {
+	struct page *page = NULL;
+
+	ASSERT (lock_held_by_current_thread (&page_cache_lock));
+
+	/* Keep at least half of the cache for pages not proven hot. */
+	while (active_cnt > max_pages / 2){
+		struct page *p = list_entry (list_pop_front (&active_list),
+				struct page, page_cache.lru_elem);
+		p->page_cache.active = false;
+		active_cnt--;
+		list_push_back (&inactive_list, &p->page_cache.lru_elem);
+	}
+
+	if (!list_empty (&free_list))
+		page = list_entry (list_pop_front (&free_list),
+				struct page, page_cache.lru_elem);
+	else if (page_cnt < max_pages){
+		void *kva = palloc_get_page (0);
+
+		page = malloc (sizeof *page);
+		if (page != NULL)
+			page->frame = malloc (sizeof *page->frame);
+		if (kva == NULL || page == NULL || page->frame == NULL){
+			palloc_free_page (kva);
+			if (page != NULL)
+				free (page->frame);
+			free (page);
+			page = NULL;
+		} else {
+			page->frame->page = page;
+			page_cache_initializer (page, VM_PAGE_CACHE, kva);
+			page_cnt++;
+		}
+	}
+
+	if (page == NULL){
+		page = page_cache_victim (&inactive_list, wait);
+		if (page == NULL)
+			page = page_cache_victim (&active_list, wait);
+		if (page == NULL){
+			if (wait){
+				lock_release (&page_cache_lock);
+				thread_yield ();
+				lock_acquire (&page_cache_lock);
+			}
+			return NULL;
+		}
+
+		if (page->page_cache.dirty != 0){
+			page->page_cache.pin_cnt++;
+			lock_release (&page_cache_lock);
+			lock_acquire (&page->page_cache.lock);
+			swap_out (page);
+			lock_release (&page->page_cache.lock);
+			lock_acquire (&page_cache_lock);
+			page->page_cache.pin_cnt--;
+			return NULL;
+		}
+		page_cache_unlink (page);
+		list_remove (&page->page_cache.lru_elem);
+		if (page->page_cache.active)
+			active_cnt--;
+	}
+
+	page->page_cache.valid = 0;
+	page->page_cache.active = page->page_cache.prefetched = false;
+	list_push_back (&inactive_list, &page->page_cache.lru_elem);
+	return page;
+}
+
+/* Takes clean, unpinned PAGE out of the index. */
+static void
+page_cache_unlink (struct page *page) {
+	struct page_cache *pc = &page->page_cache;
+
+	ASSERT (pc->dirty == 0);
+	if (pc->inode_sector != (disk_sector_t) -1)
+		hash_delete (&page_map, &pc->hash_elem);
+	pc->inode_sector = -1;
+	memset (pc->sectors, 0xff, sizeof pc->sectors);
+	pc->valid = 0;
+}
+
+/* Returns the page caching offset OFS of INODE, which must be
+ * page-aligned, pinned and with its lock held.  The page may not
+ * have any valid data yet.  Release it with page_cache_put().
+ * ACCESSED tells whether this is a new access to the page rather
+ * than a continuation of the last one. */
+static struct page *
+page_cache_get (struct inode *inode, off_t ofs, bool accessed) {
+	disk_sector_t inode_sector = inode_get_inumber (inode);
+	struct page *page;
+
+	ASSERT (ofs % PGSIZE == 0);
+
+	lock_acquire (&page_cache_lock);
+	for (;;){
+		page = page_cache_find (inode_sector, ofs);
+		if (page != NULL){
+			struct page_cache *pc = &page->page_cache;
+
+			if (pc->prefetched && accessed)
+				pc->prefetched = false;
+			else if (accessed && !pc->active){
+				pc->active = true;
+				active_cnt++;
+			}
+			list_remove (&pc->lru_elem);
+			list_push_back (pc->active ? &active_list : &inactive_list,
+					&pc->lru_elem);
+			break;
+		}
+		page = page_cache_alloc (true);
+		if (page != NULL){
+			page->page_cache.inode_sector = inode_sector;
+			page->page_cache.ofs = ofs;
+			hash_insert (&page_map, &page->page_cache.hash_elem);
+			break;
+		}
+	}
+	page->page_cache.pin_cnt++;
+	lock_release (&page_cache_lock);
+
+	lock_acquire (&page->page_cache.lock);
+	page_cache_map (inode, page);
+	return page;
+}
+
+/* Releases PAGE obtained from page_cache_get(), marking the
+ * sectors in DIRTY as dirty.  A page whose file was deleted
+ * meanwhile is not written back and goes back to the free list. */
+static void
+page_cache_put (struct page *page, uint8_t dirty) {
+	struct page_cache *pc = &page->page_cache;
+
+	lock_acquire (&page_cache_lock);
+	if (dirty != 0 && pc->inode_sector != (disk_sector_t) -1){
+		if (pc->dirty == 0 && dirty_cnt++ == 0)
+			dirty_since = timer_ticks ();
+		pc->dirty |= dirty;
+		pc->valid |= dirty;
+	}
+	lock_release (&pc->lock);
+	if (--pc->pin_cnt == 0 && pc->inode_sector == (disk_sector_t) -1){
+		list_remove (&pc->lru_elem);
+		if (pc->active)
+			active_cnt--;
+		pc->active = false;
+		list_push_back (&free_list, &pc->lru_elem);
+	}
+	lock_release (&page_cache_lock);
+}
+
+/* Looks up the backing sectors of locked PAGE of INODE that were
+ * not allocated when it was last mapped.  A newly allocated sector
+ * may still be in the buffer cache from its previous owner, and
+ * must not be written back from there over the file's data. */
+static void
+page_cache_map (struct inode *inode, struct page *page) {
+	struct page_cache *pc = &page->page_cache;
+	int i;
+
+	ASSERT (lock_held_by_current_thread (&pc->lock));
+
+	for (i = 0; i < PAGE_CACHE_SECTORS; i++)
+		if (pc->sectors[i] == (disk_sector_t) -1){
+			pc->sectors[i] =
+				inode_byte_to_sector (inode, pc->ofs + i * DISK_SECTOR_SIZE);
+			if (pc->sectors[i] != (disk_sector_t) -1)
+				buffer_cache_discard (pc->sectors[i]);
+		}
+}
+
+/* Reads the sectors of locked PAGE that are in MASK and not yet
+ * valid.  Sectors not allocated on disk read as zeros. */
+static void
+page_cache_fill (struct page *page, uint8_t mask) {
+	struct page_cache *pc = &page->page_cache;
+	uint8_t *kva = page->frame->kva;
+	uint8_t filled = 0;
+	int i, j;
+
+	ASSERT (lock_held_by_current_thread (&pc->lock));
+
+	/* Read each run of sectors that are contiguous on disk with one
+	 * command. */
+	mask &= ~pc->valid;
+	for (i = 0; i < PAGE_CACHE_SECTORS; i = j){
+		j = i + 1;
+		if (!(mask & (1 << i)))
+			continue;
+		if (pc->sectors[i] == (disk_sector_t) -1)
+			memset (kva + i * DISK_SECTOR_SIZE, 0, DISK_SECTOR_SIZE);
+		else {
+			buffer_cache_discard (pc->sectors[i]);
+			for (; j < PAGE_CACHE_SECTORS && (mask & (1 << j))
+					&& pc->sectors[j] == pc->sectors[i] + (j - i); j++)
+				buffer_cache_discard (pc->sectors[j]);
+			disk_read_multi (filesys_disk, pc->sectors[i],
+					kva + i * DISK_SECTOR_SIZE, j - i);
+		}
+		filled |= ((1 << j) - 1) & ~((1 << i) - 1);
+	}
+	if (filled != 0){
+		lock_acquire (&page_cache_lock);
+		pc->valid |= filled;
+		lock_release (&page_cache_lock);
+	}
+}
+
+/* Returns the mask of the sectors of a page that bytes
+ * [OFS, OFS + SIZE) within it overlap. */
+static uint8_t
+sector_mask (off_t ofs, size_t size) {
+	int first = ofs / DISK_SECTOR_SIZE;
+	int last = (ofs + size - 1) / DISK_SECTOR_SIZE;
+	return ((1 << (last + 1)) - 1) & ~((1 << first) - 1);
+}
+
+/* Copies SIZE bytes at OFFSET in INODE, which must lie within one
+ * page and within the file, into BUFFER.  BUFFER must not be a
+ * user address: a page fault on it while the page is locked could
+ * need the same page, as when it is mmap'd from the same file. */
+void
+page_cache_read (struct inode *inode, void *buffer, off_t offset,
+		size_t size, bool accessed) {
+	off_t page_ofs = offset % PGSIZE;
+	struct page *page;
+
+	ASSERT (size > 0 && page_ofs + size <= PGSIZE);
+	ASSERT (!is_user_vaddr (buffer));
+
+	page = page_cache_get (inode, offset - page_ofs, accessed);
+	page_cache_fill (page, sector_mask (page_ofs, size));
+	memcpy (buffer, (uint8_t *) page->frame->kva + page_ofs, size);
+	page_cache_put (page, 0);
+}
+
+/* Copies SIZE bytes from BUFFER to OFFSET in INODE, which must lie
+ * within one page and within the file's allocated sectors.
+ * Sectors that are only partly overwritten are read in first.
+ * BUFFER must not be a user address, as in page_cache_read(). */
+void
+page_cache_write (struct inode *inode, const void *buffer, off_t offset,
+		size_t size, bool accessed) {
+	off_t page_ofs = offset % PGSIZE;
+	uint8_t mask = sector_mask (page_ofs, size);
+	uint8_t partial = 0;
+	struct page *page;
+
+	ASSERT (size > 0 && page_ofs + size <= PGSIZE);
+	ASSERT (!is_user_vaddr (buffer));
+
+	if (page_ofs % DISK_SECTOR_SIZE != 0)
+		partial |= sector_mask (page_ofs, 1);
+	if ((page_ofs + size) % DISK_SECTOR_SIZE != 0)
+		partial |= sector_mask (page_ofs + size - 1, 1);
+
+	page = page_cache_get (inode, offset - page_ofs, accessed);
+	page_cache_fill (page, partial);
+	memcpy ((uint8_t *) page->frame->kva + page_ofs, buffer, size);
+	page_cache_put (page, mask);
+}
+
+/* Returns the page at OFFSET in INODE, which must be page-aligned
+ * and wholly within the file, with all of its data read in, for
+ * mapping into a process.  The page stays pinned until released
+ * with page_cache_unshare().  Directories and symbolic links are
+ * never shared, since their data is in the buffer cache.  If
+ * WRITABLE is true, the page's sectors must all be allocated, since
+ * stores through the mapping have to be written back to them.
+ * Returns a null pointer if the page cannot be shared, in which
+ * case the caller makes a private copy. */
+struct page *
+page_cache_share (struct inode *inode, off_t offset, bool writable) {
+	struct page *page;
+	int i;
+
+	ASSERT (offset % PGSIZE == 0);
+
+	if (!inode_uses_page_cache (inode))
+		return NULL;
+	lock_acquire (&page_cache_lock);
+	if (share_cnt >= max_pages / 2){
+		lock_release (&page_cache_lock);
+		return NULL;
+	}
+	share_cnt++;
+	lock_release (&page_cache_lock);
+
+	page = page_cache_get (inode, offset, true);
+	page_cache_fill (page, ALL_SECTORS);
+	for (i = 0; writable && i < PAGE_CACHE_SECTORS; i++)
+		if (page->page_cache.sectors[i] == (disk_sector_t) -1){
+			page_cache_put (page, 0);
+			lock_acquire (&page_cache_lock);
+			share_cnt--;
+			lock_release (&page_cache_lock);
+			return NULL;
+		}
+	lock_release (&page->page_cache.lock);
+	return page;
+}
+
+/* Shares PAGE, returned by page_cache_share(), once more, as for a
+ * child process that inherits the mapping. */
+void
+page_cache_dup (struct page *page) {
+	lock_acquire (&page_cache_lock);
+	page->page_cache.pin_cnt++;
+	share_cnt++;
+	lock_release (&page_cache_lock);
+}
+
+/* Marks all of shared PAGE dirty, after a process stored to it
+ * through its mapping. */
+void
+page_cache_mark_dirty (struct page *page) {
+	struct page_cache *pc = &page->page_cache;
+
+	lock_acquire (&page_cache_lock);
+	if (pc->inode_sector != (disk_sector_t) -1){
+		if (pc->dirty == 0 && dirty_cnt++ == 0)
+			dirty_since = timer_ticks ();
+		pc->dirty = pc->valid = ALL_SECTORS;
+	}
+	lock_release (&page_cache_lock);
+}
+
+/* Releases a share of PAGE obtained from page_cache_share() or
+ * page_cache_dup().  The caller must have unmapped it already. */
+void
+page_cache_unshare (struct page *page) {
+	lock_acquire (&page_cache_lock);
+	share_cnt--;
+	lock_release (&page_cache_lock);
+
+	lock_acquire (&page->page_cache.lock);
+	page_cache_put (page, 0);
+}
+
+/* Asks the worker thread to read the page at OFFSET in INODE into
+ * the cache, unless the page is cached already or too many
+ * requests are pending. */
+void
+page_cache_prefetch (struct inode *inode, off_t offset) {
+	disk_sector_t inode_sector = inode_get_inumber (inode);
+	struct page_cache_job *job;
+	int i;
+
+	offset -= offset % PGSIZE;
+	if (job_cnt >= max_pages / 2)
+		return;
+	job = malloc (sizeof *job);
+	if (job == NULL)
+		return;
+	job->inode_sector = inode_sector;
+	job->ofs = offset;
+	for (i = 0; i < PAGE_CACHE_SECTORS; i++)
+		job->sectors[i] =
+			inode_byte_to_sector (inode, offset + i * DISK_SECTOR_SIZE);
+
+	lock_acquire (&page_cache_lock);
+	if (page_cache_find (inode_sector, offset) != NULL){
+		lock_release (&page_cache_lock);
+		free (job);
+		return;
+	}
+	list_push_back (&job_queue, &job->elem);
+	job_cnt++;
+	lock_release (&page_cache_lock);
+	sema_up (&job_wait);
+}
+
+/* Discards the cached pages and pending read-ahead of INODE, whose
+ * file is being deleted, without writing anything back. */
+void
+page_cache_drop (struct inode *inode) {
+	disk_sector_t inode_sector = inode_get_inumber (inode);
+	struct list_elem *e, *next;
+	int i;
+
+	lock_acquire (&page_cache_lock);
+	for (e = list_begin (&job_queue); e != list_end (&job_queue); e = next){
+		struct page_cache_job *job = list_entry (e, struct page_cache_job, elem);
+		next = list_next (e);
+		if (job->inode_sector == inode_sector){
+			list_remove (e);
+			job_cnt--;
+			free (job);
+		}
+	}
+
+	for (i = 0; i < 2; i++){
+		struct list *list = i == 0 ? &inactive_list : &active_list;
+
+		for (e = list_begin (list); e != list_end (list); e = next){
+			struct page *page = list_entry (e, struct page, page_cache.lru_elem);
+			struct page_cache *pc = &page->page_cache;
+
+			next = list_next (e);
+			if (pc->inode_sector != inode_sector)
+				continue;
+			if (pc->dirty != 0){
+				pc->dirty = 0;
+				dirty_cnt--;
+			}
+			page_cache_unlink (page);
+
+			/* A pinned page goes to the free list when its last
+			 * user puts it. */
+			if (pc->pin_cnt == 0){
+				list_remove (e);
+				if (pc->active)
+					active_cnt--;
+				pc->active = false;
+				list_push_back (&free_list, e);
+			}
+		}
+	}
+	lock_release (&page_cache_lock);
+}
+
+/* Orders pages by their first backing sector for qsort(). */
+static int
+compare_pages (const void *a_, const void *b_) {
+	const struct page *a = *(const struct page *const *) a_;
+	const struct page *b = *(const struct page *const *) b_;
+	disk_sector_t x = a->page_cache.sectors[0];
+	disk_sector_t y = b->page_cache.sectors[0];
+	return x < y ? -1 : x > y;
+}
+
+/* Writes all dirty pages back, in ascending order of their first
+ * sector.  Pages are locked one at a time. */
+void
+page_cache_flush (void) {
+	struct page **pages;
+	struct list_elem *e;
+	size_t cnt = 0, i;
+	int l;
+
+	lock_acquire (&page_cache_lock);
+	if (dirty_cnt == 0
+			|| (pages = malloc (dirty_cnt * sizeof *pages)) == NULL){
+		lock_release (&page_cache_lock);
+		return;
+	}
+	for (l = 0; l < 2; l++){
+		struct list *list = l == 0 ? &inactive_list : &active_list;
+
+		for (e = list_begin (list);
+				e != list_end (list) && cnt < dirty_cnt; e = list_next (e)){
+			struct page *page = list_entry (e, struct page, page_cache.lru_elem);
+			if (page->page_cache.dirty != 0){
+				page->page_cache.pin_cnt++;
+				pages[cnt++] = page;
+			}
+		}
+	}
+	lock_release (&page_cache_lock);
+
+	qsort (pages, cnt, sizeof *pages, compare_pages);
+	for (i = 0; i < cnt; i++){
+		lock_acquire (&pages[i]->page_cache.lock);
+		swap_out (pages[i]);
+		page_cache_put (pages[i], 0);
+	}
+	free (pages);
 }
+#endif /* EFILESYS */
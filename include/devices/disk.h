@@ -2,6 +2,9 @@
 #define DEVICES_DISK_H
 
 #include <inttypes.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 /* Size of a disk sector in bytes. */
@@ -11,17 +14,110 @@
  * Good enough for disks up to 2 TB. */
 typedef uint32_t disk_sector_t;
 
+/* Maximum number of sectors transferred by one ATA command. */
+#define DISK_MAX_SECTORS 256
+
+/* A request to transfer CNT consecutive sectors, starting at
+   SEC_NO, between DISK and memory.  Sector i is at BUFFER + i *
+   DISK_SECTOR_SIZE or, for a write with BUFFERS nonnull, at
+   BUFFERS[i].  See disk_submit(). */
+struct disk_request {
+	struct list_elem elem;          /* Element in the channel's queue. */
+	struct disk *disk;              /* Disk to transfer from or to. */
+	disk_sector_t sec_no;           /* First sector. */
+	size_t cnt;                     /* 1 to DISK_MAX_SECTORS sectors. */
+	bool write;                     /* Write to the disk? */
+	void *buffer;                   /* Data, not modified by writes. */
+	const void *const *buffers;     /* Per-sector data of a write. */
+	void (*complete) (struct disk_request *);   /* Called when done. */
+	void *aux;                      /* For COMPLETE's use. */
+
+	/* Owned by the disk layer. */
+	uint64_t submit_tsc;            /* TSC when submitted. */
+	uint64_t issue_tsc;             /* TSC when issued to the device. */
+
+	/* Owned by the driver. */
+	size_t done;                    /* Sectors moved by PIO, or handed to
+	                                   a virtio-blk device, so far. */
+	size_t parts;                   /* virtio-blk requests outstanding. */
+	bool dma;                       /* Transferred by DMA? */
+};
+
+/* Operations on a disk, supplied by the driver behind it.  Reads,
+   writes and multi-sector transfers of every size all come down
+   to SUBMIT or, for a driver without it, TRANSFER. */
+struct disk_operations {
+	/* Starts the transfer that R describes, as disk_submit() says.
+	   Called with interrupts off. */
+	void (*submit) (struct disk *, struct disk_request *r);
+	/* Moves the data that R describes right away, for a driver
+	   that never has to wait for its device.  Called with
+	   interrupts as disk_submit()'s caller had them; disk_submit()
+	   completes R afterward. */
+	void (*transfer) (struct disk *, struct disk_request *r);
+	/* Waits until data written so far is in stable storage, or
+	   null if the disk keeps none in a volatile cache. */
+	void (*flush) (struct disk *);
+};
+
+/* Number of buckets in a latency histogram.  Bucket I counts
+   latencies of 2**I to 2**(I+1) - 1 TSC cycles, and the last one
+   also counts any longer ones. */
+#define DISK_HIST_BUCKETS 40
+
+/* Latencies of one kind of request to one disk, in TSC cycles. */
+struct disk_latency {
+	long long hist[DISK_HIST_BUCKETS];  /* Log-scale histogram. */
+	long long cnt;                  /* Number of requests. */
+	uint64_t total;                 /* Sum of latencies. */
+	uint64_t max;                   /* Longest latency. */
+};
+
+/* A disk: an array of DISK_SECTOR_SIZE-byte sectors behind some
+   driver.  The driver embeds it in its own per-disk structure and
+   makes it available with disk_register(). */
+struct disk {
+	char name[8];                   /* Name, e.g. "hd0:1". */
+	disk_sector_t capacity;         /* Capacity in sectors. */
+	const struct disk_operations *ops;  /* Driver's operations. */
+
+	long long read_cnt;             /* Number of sectors read. */
+	long long write_cnt;            /* Number of sectors written. */
+
+	/* Request statistics, indexed by the requests' WRITE. */
+	struct disk_latency wait[2];    /* From submission to issue. */
+	struct disk_latency service[2]; /* From issue to completion. */
+	int depth;                      /* Requests submitted, not completed. */
+	int max_depth;                  /* Highest DEPTH so far. */
+	long long depth_sum;            /* Sum of DEPTH after each submission. */
+	long long submit_cnt;           /* Number of requests submitted. */
+};
+
 /* Format specifier for printf(), e.g.:
  * printf ("sector=%"PRDSNu"\n", sector); */
 #define PRDSNu PRIu32
 
+/* -pio: Never use DMA? */
+extern bool disk_pio;
+
 void disk_init (void);
 void disk_print_stats (void);
 
+void disk_register (struct disk *, int chan_no, int dev_no);
 struct disk *disk_get (int chan_no, int dev_no);
 disk_sector_t disk_size (struct disk *);
 void disk_read (struct disk *, disk_sector_t, void *);
 void disk_write (struct disk *, disk_sector_t, const void *);
+void disk_read_multi (struct disk *, disk_sector_t, void *, size_t cnt);
+void disk_write_multi (struct disk *, disk_sector_t, const void *, size_t cnt);
+void disk_writev (struct disk *, disk_sector_t, const void *const[], size_t cnt);
+void disk_submit (struct disk_request *);
+void disk_issued (struct disk_request *);
+void disk_complete (struct disk_request *);
+void disk_flush (struct disk *);
+bool disk_set_dma (struct disk *, bool dma);
+long long disk_read_cnt (struct disk *);
+long long disk_write_cnt (struct disk *);
 
 void 	register_disk_inspect_intr ();
 #endif /* devices/disk.h */
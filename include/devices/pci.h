@@ -0,0 +1,9 @@
+#ifndef DEVICES_PCI_H
+#define DEVICES_PCI_H
+
+#include <stdint.h>
+
+uint32_t pci_read_config (int dev, int func, int reg);
+void pci_write_config (int dev, int func, int reg, uint32_t);
+
+#endif /* devices/pci.h */
@@ -0,0 +1,8 @@
+#ifndef DEVICES_RAMDISK_H
+#define DEVICES_RAMDISK_H
+
+#include "devices/disk.h"
+
+struct disk *ramdisk_create (const char *name, disk_sector_t size);
+
+#endif /* devices/ramdisk.h */
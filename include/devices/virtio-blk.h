@@ -0,0 +1,15 @@
+#ifndef DEVICES_VIRTIO_BLK_H
+#define DEVICES_VIRTIO_BLK_H
+
+#include "devices/disk.h"
+
+/* A virtio-blk device in PCI slot VIRTIO_BLK_SLOT + 2 * CHAN_NO +
+   DEV_NO stands in for ATA disk hdCHAN_NO:DEV_NO, if that is
+   missing.
+   utils/pintos --virtio puts the file system and swap disks
+   there. */
+#define VIRTIO_BLK_SLOT 0x18
+
+void virtio_blk_init (void);
+
+#endif /* devices/virtio-blk.h */
@@ -14,25 +14,36 @@ typedef uint32_t cluster_t;  /* Index of a cluster within FAT. */
 #define EOChain 0x0FFFFFFF   /* End of cluster chain */
 
 /* Sectors of FAT information. */
-#define SECTORS_PER_CLUSTER 1 /* Number of sectors per cluster */
+#define SECTORS_PER_CLUSTER 1 /* Default number of sectors per cluster */
+#define MAX_SECTORS_PER_CLUSTER 64 /* Largest number of sectors per cluster */
 #define FAT_BOOT_SECTOR 0     /* FAT boot sector. */
 #define ROOT_DIR_CLUSTER 1    /* Cluster for the root directory */
 
+/* -cluster: Sectors per cluster to format with, 0 for
+   SECTORS_PER_CLUSTER. */
+extern unsigned int format_cluster_sectors;
+
 void fat_init (void);
 void fat_open (void);
 void fat_close (void);
 void fat_create (void);
+void fat_flush (void);
 void fat_close (void);
 
 cluster_t fat_create_chain (
     cluster_t clst /* Cluster # to stretch, 0: Create a new chain */
 );
+cluster_t fat_allocate_run (
+    size_t cnt,    /* Number of clusters to allocate */
+    cluster_t hint /* Cluster to allocate right after, 0: no preference */
+);
 void fat_remove_chain (
     cluster_t clst, /* Cluster # to be removed */
     cluster_t pclst /* Previous cluster of clst, 0: clst is the start of chain */
 );
 cluster_t fat_get (cluster_t clst);
 void fat_put (cluster_t clst, cluster_t val);
+unsigned int fat_cluster_sectors (void);
 disk_sector_t cluster_to_sector (cluster_t clst);
 cluster_t sector_to_cluster(disk_sector_t sec);
 
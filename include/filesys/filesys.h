@@ -2,38 +2,93 @@
 #define FILESYS_FILESYS_H
 
 #include <stdbool.h>
+#include <fsstat.h>
+#include <hash.h>
+#include <list.h>
 #include "filesys/off_t.h"
 #include "filesys/directory.h"
+#include "threads/synch.h"
 
 /* Sectors of system file inodes. */
 #define FREE_MAP_SECTOR 0       /* Free map file inode sector. */
 // #define ROOT_DIR_SECTOR 1       /* Root directory file inode sector. */
 #define ROOT_DIR_SECTOR 1       /* Root directory file inode sector. */
 
+/* Number of buffer cache slots when no -bc option is given. */
+#define BUFFER_CACHE_DEFAULT_SIZE 64
+
 struct buffer_cache_entry {
     bool dirty_bit;
-    int clock_bit;
+    bool prefetched;                /* Read ahead and not referenced since. */
+    bool frequent;                  /* On t2 rather than t1. */
     disk_sector_t sector;
+    uint64_t hold_start;            /* TSC when LOCK was last acquired. */
     uint8_t *buffer;
+    struct lock lock;               /* Held while BUFFER is used or filled. */
+    int pin_cnt;                    /* Threads holding or waiting for LOCK. */
+    struct hash_elem hash_elem;     /* Element in buffer_cache's sector_map. */
+    struct list_elem lru_elem;      /* Element in free_list, t1 or t2. */
+};
+
+/* A sector recently evicted from the buffer cache, remembered by
+ * number only so that ARC can tell when it is referenced again. */
+struct buffer_cache_ghost {
+    disk_sector_t sector;
+    bool frequent;                  /* On b2 rather than b1. */
+    struct hash_elem hash_elem;     /* Element in buffer_cache's ghost_map. */
+    struct list_elem elem;          /* Element in ghost_free, b1 or b2. */
 };
 
 struct buffer_cache {
     uint32_t buffer_cache_size;
     struct buffer_cache_entry *buffer_array;
-    //struct lock *lock;
+    uint8_t *data;                  /* Sector data of all slots. */
+    size_t data_pages;              /* Number of pages in DATA. */
+    struct hash sector_map;         /* Cached slots, keyed by sector. */
+    struct list free_list;          /* Slots not holding any sector. */
+
+    /* Adaptive replacement (ARC).  Each list is ordered from least
+     * to most recently used. */
+    struct list t1;                 /* Cached slots referenced once. */
+    struct list t2;                 /* Cached slots referenced again since. */
+    struct list b1;                 /* Ghosts of slots evicted from t1. */
+    struct list b2;                 /* Ghosts of slots evicted from t2. */
+    size_t t1_cnt, t2_cnt, b1_cnt, b2_cnt;
+    size_t target;                  /* Adaptive target size of t1. */
+    struct buffer_cache_ghost *ghost_array;
+    struct hash ghost_map;          /* Ghosts on b1 or b2, keyed by sector. */
+    struct list ghost_free;         /* Unused elements of ghost_array. */
+
+    struct lock lock;               /* Protects the members above and slot metadata. */
+    size_t dirty_cnt;               /* Number of dirty slots. */
+
+    struct list ra_queue;           /* Sectors waiting to be read ahead. */
+    size_t ra_pending;              /* Number of elements in ra_queue. */
+    struct lock ra_lock;            /* Protects ra_queue. */
+    struct semaphore ra_wait;       /* Up'd for each queued sector. */
+
+    bool closing;                   /* Asks the cache threads to exit. */
+    struct semaphore daemon_done;   /* Up'd by each cache thread on exit. */
 };
 
 
 /* Disk used for file system. */
 extern struct disk *filesys_disk;
-//struct lock *buffer_read_lock;
-//struct lock *buffer_write_lock;
-struct lock *buffer_lock;
-struct lock *buffer_evict_lock;
 
+/* -bc: Buffer cache size in megabytes, 0 for the default. */
+extern size_t buffer_cache_mb;
+
+void buffer_cache_init(void);
+void buffer_cache_close(void);
 void buffer_cache_read(disk_sector_t sector_idx, void *buffer);
-unsigned int buffer_cache_evict(void);
-bool buffer_cache_write(disk_sector_t sector_idx, void* buffer);
+bool buffer_cache_write(disk_sector_t sector_idx, const void *buffer);
+void *buffer_cache_pin (disk_sector_t sector, bool read);
+void buffer_cache_unpin (const void *data, bool dirty);
+void buffer_cache_flush (void);
+void buffer_cache_discard (disk_sector_t);
+void buffer_cache_readahead (disk_sector_t sector);
+void buffer_cache_get_stats (struct fsstat *);
+void buffer_cache_print_stats (void);
 void filesys_init (bool format);
 void filesys_done (void);
 bool filesys_create (const char *name, off_t initial_size);
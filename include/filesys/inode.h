@@ -2,12 +2,24 @@
 #define FILESYS_INODE_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include "filesys/off_t.h"
 #include "devices/disk.h"
+#include "threads/synch.h"
 #include <list.h>
 
 struct bitmap;
 
+/* A run of CNT clusters starting at cluster START. */
+struct inode_extent {
+	uint32_t start;
+	uint32_t cnt;
+};
+
+/* Extents kept in the inode itself, and in its extent block. */
+#define INODE_EXTENTS 59
+#define EXTENT_BLOCK_EXTENTS (DISK_SECTOR_SIZE / sizeof (struct inode_extent))
+
 /* On-disk inode.
  * Must be exactly DISK_SECTOR_SIZE bytes long. */
 struct inode_disk {
@@ -16,7 +28,12 @@ struct inode_disk {
 	uint32_t is_directory;
 	uint32_t is_symlink;
 	unsigned magic;                     /* Magic number. */
-	uint32_t unused[123];               /* Not used. */
+	uint32_t has_extents;               /* Do the extents map the data? If
+	                                       not, only the FAT chain does. */
+	uint32_t extent_cnt;                /* Number of extents. */
+	disk_sector_t extent_block;         /* Sector holding the extents past
+	                                       INODE_EXTENTS, or 0. */
+	struct inode_extent extents[INODE_EXTENTS]; /* The first extents. */
 };
 
 /* In-memory inode. */
@@ -26,6 +43,16 @@ struct inode {
 	int open_cnt;                       /* Number of openers. */
 	bool removed;                       /* True if deleted, false otherwise. */
 	int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+	off_t ra_next;                      /* Offset a sequential read continues at. */
+	off_t ra_end;                       /* Read-ahead issued up to here. */
+	size_t ra_window;                   /* Read-ahead window, in sectors. */
+	off_t pc_last;                      /* Page cache page accessed last. */
+	uint32_t *clst_map;                 /* Disk cluster of each file cluster,
+	                                       filled in as the chain is walked. */
+	size_t clst_cnt;                    /* Entries filled in CLST_MAP. */
+	size_t clst_cap;                    /* Entries CLST_MAP has room for. */
+	bool clst_end;                      /* CLST_MAP covers the whole chain? */
+	struct lock clst_lock;              /* Guards CLST_MAP and the above. */
 	struct inode_disk data;             /* Inode content. */
 };
 
@@ -35,6 +62,7 @@ bool inode_create (disk_sector_t, off_t, int symlink);
 struct inode *inode_open (disk_sector_t);
 struct inode *inode_reopen (struct inode *);
 disk_sector_t inode_get_inumber (const struct inode *);
+disk_sector_t inode_byte_to_sector (struct inode *, off_t pos);
 void inode_close (struct inode *);
 void inode_remove (struct inode *);
 off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
@@ -42,5 +70,6 @@ off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
 off_t inode_length (const struct inode *);
+bool inode_uses_page_cache (const struct inode *);
 
 #endif /* filesys/inode.h */
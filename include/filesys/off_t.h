@@ -6,10 +6,10 @@
 /* An offset within a file.
  * This is a separate header because multiple headers want this
  * definition but not any others. */
-typedef int32_t off_t;
+typedef int64_t off_t;
 
 /* Format specifier for printf(), e.g.:
  * printf ("offset=%"PROTd"\n", offset); */
-#define PROTd PRId32
+#define PROTd PRId64
 
 #endif /* filesys/off_t.h */
@@ -1,12 +1,55 @@
 #ifndef FILESYS_PAGE_CACHE_H
 #define FILESYS_PAGE_CACHE_H
-#include "vm/vm.h"
+#include <hash.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/disk.h"
+#include "filesys/off_t.h"
+#include "threads/synch.h"
 
 struct page;
+struct inode;
 enum vm_type;
 
-struct page_cache {};
+/* Number of disk sectors in one page cache page. */
+#define PAGE_CACHE_SECTORS 8
 
-void page_cache_init (void);
+/* -pc: Page cache size in megabytes, 0 for the default. */
+extern size_t page_cache_mb;
+
+/* A page of regular file data, cached in a kernel page.  The page
+ * holds bytes [OFS, OFS + PGSIZE) of the file whose inode is at
+ * INODE_SECTOR, and is filled and written back a sector at a
+ * time. */
+struct page_cache {
+	disk_sector_t inode_sector;     /* File's inode, or -1 if none. */
+	off_t ofs;                      /* Page-aligned offset within the file. */
+	disk_sector_t sectors[PAGE_CACHE_SECTORS]; /* Backing sectors, -1 if
+	                                   not allocated yet. */
+	uint8_t valid;                  /* Sectors with data, one bit each. */
+	uint8_t dirty;                  /* Sectors not written back, one bit each. */
+	struct lock lock;               /* Held while the data is used or filled. */
+	int pin_cnt;                    /* Threads holding or waiting for LOCK. */
+	bool active;                    /* On the active list? */
+	bool prefetched;                /* Read ahead and not accessed since? */
+	struct hash_elem hash_elem;     /* Element in the page index. */
+	struct list_elem lru_elem;      /* Element in the free, inactive or
+	                                   active list. */
+};
+
+void pagecache_init (void);
+void page_cache_done (void);
 bool page_cache_initializer (struct page *page, enum vm_type type, void *kva);
+void page_cache_read (struct inode *, void *buffer, off_t offset, size_t size,
+		bool accessed);
+void page_cache_write (struct inode *, const void *buffer, off_t offset,
+		size_t size, bool accessed);
+struct page *page_cache_share (struct inode *, off_t offset, bool writable);
+void page_cache_dup (struct page *);
+void page_cache_mark_dirty (struct page *);
+void page_cache_unshare (struct page *);
+void page_cache_prefetch (struct inode *, off_t offset);
+void page_cache_drop (struct inode *);
+void page_cache_flush (void);
 #endif
@@ -0,0 +1,24 @@
+#ifndef __LIB_FSSTAT_H
+#define __LIB_FSSTAT_H
+
+/* File system I/O statistics, returned by the fsstat() system
+   call and printed when Pintos powers off.  Counts cover the
+   whole run so far. */
+struct fsstat {
+	/* Buffer cache. */
+	long long cache_hits;           /* Accesses served from the cache. */
+	long long cache_misses;         /* Accesses that had to load a slot. */
+	long long cache_evictions;      /* Slots taken from another sector. */
+	long long cache_writebacks;     /* Dirty slots written to disk. */
+	long long ra_issued;            /* Sectors loaded by read-ahead. */
+	long long ra_hits;              /* Prefetched sectors later referenced. */
+	long long ra_unused;            /* Prefetched sectors evicted unreferenced. */
+	long long hold_cnt;             /* Number of times a slot was released. */
+	long long hold_cycles;          /* TSC cycles slots were held, in total. */
+
+	/* File system disk. */
+	long long disk_reads;           /* Sectors read. */
+	long long disk_writes;          /* Sectors written. */
+};
+
+#endif /* lib/fsstat.h */
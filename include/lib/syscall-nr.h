@@ -36,6 +36,8 @@ enum {
 
 	SYS_MOUNT,
 	SYS_UMOUNT,
+
+	SYS_FSSTAT,                 /* Reports file system I/O statistics. */
 };
 
 #endif /* lib/syscall-nr.h */
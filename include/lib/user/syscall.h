@@ -4,13 +4,15 @@
 #include <stdbool.h>
 #include <debug.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <fsstat.h>
 
 /* Process identifier. */
 typedef int pid_t;
 #define PID_ERROR ((pid_t) -1)
 
-/* Map region identifier. */
-typedef int off_t;
+/* Offset within a file. */
+typedef int64_t off_t;
 #define MAP_FAILED ((void *) NULL)
 
 /* Maximum characters in a filename written by readdir(). */
@@ -29,11 +31,11 @@ int wait (pid_t);
 bool create (const char *file, unsigned initial_size);
 bool remove (const char *file);
 int open (const char *file);
-int filesize (int fd);
+off_t filesize (int fd);
 int read (int fd, void *buffer, unsigned length);
 int write (int fd, const void *buffer, unsigned length);
-void seek (int fd, unsigned position);
-unsigned tell (int fd);
+void seek (int fd, off_t position);
+off_t tell (int fd);
 void close (int fd);
 
 int dup2(int oldfd, int newfd);
@@ -50,6 +52,8 @@ bool isdir (int fd);
 int inumber (int fd);
 int symlink (const char* target, const char* linkpath);
 
+bool fsstat (struct fsstat *);
+
 static inline void* get_phys_addr (void *user_addr) {
 	void* pa;
 	asm volatile ("movq %0, %%rax" ::"r"(user_addr));
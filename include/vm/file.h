@@ -8,6 +8,7 @@ enum vm_type;
 
 struct file_page {
 	struct segment_info *info;
+	struct page *cache;     /* Page cache page mapped here, or NULL. */
 };
 
 void vm_file_init (void);
@@ -15,4 +16,7 @@ bool file_backed_initializer (struct page *page, enum vm_type type, void *kva);
 void *do_mmap(void *addr, size_t length, int writable,
 		struct file *file, off_t offset);
 void do_munmap (void *va);
+#ifdef EFILESYS
+bool file_backed_share (struct page *page);
+#endif
 #endif
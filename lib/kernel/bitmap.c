@@ -272,7 +272,20 @@ bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value) {
 	ASSERT (b != NULL);
 	ASSERT (start <= b->bit_cnt);
 
-	if (cnt <= b->bit_cnt) {
+	if (cnt == 1) {
+		/* Looking for a single bit is common enough to be worth
+		   stepping over whole elements that cannot contain it. */
+		elem_type full = value ? 0 : (elem_type) -1;
+		size_t i = start;
+		while (i < b->bit_cnt) {
+			if (i % ELEM_BITS == 0 && b->bits[elem_idx (i)] == full)
+				i += ELEM_BITS;
+			else if (bitmap_test (b, i) == value)
+				return i;
+			else
+				i++;
+		}
+	} else if (cnt <= b->bit_cnt) {
 		size_t last = b->bit_cnt - cnt;
 		size_t i;
 		for (i = start; i <= last; i++)
@@ -110,7 +110,7 @@ open (const char *file) {
 	return syscall1 (SYS_OPEN, file);
 }
 
-int
+off_t
 filesize (int fd) {
 	return syscall1 (SYS_FILESIZE, fd);
 }
@@ -126,11 +126,11 @@ write (int fd, const void *buffer, unsigned size) {
 }
 
 void
-seek (int fd, unsigned position) {
+seek (int fd, off_t position) {
 	syscall2 (SYS_SEEK, fd, position);
 }
 
-unsigned
+off_t
 tell (int fd) {
 	return syscall1 (SYS_TELL, fd);
 }
@@ -194,3 +194,8 @@ int
 umount (const char *path) {
 	return syscall1 (SYS_UMOUNT, path);
 }
+
+bool
+fsstat (struct fsstat *st) {
+	return syscall1 (SYS_FSSTAT, st);
+}
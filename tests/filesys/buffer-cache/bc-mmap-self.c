@@ -0,0 +1,63 @@
+/* Calls read() into, and write() from, a memory mapping of the
+   same page of the file that is being read or written, before
+   that page of the mapping has been touched.  Faulting the
+   mapping in needs the file's cached page, so the kernel must not
+   be holding that page while it copies to or from the user
+   buffer. */
+
+#include <random.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE (2 * 4096)
+
+static const char file_name[] = "self";
+static char buf[FILE_SIZE];
+static char *map = (char *) 0x10000000;
+
+/* Maps the file open as FD at MAP and touches only its second
+   page.  That sets up the page table that the system calls check
+   for, while the first page is left for them to fault in. */
+static void *
+map_file (int fd) {
+  void *mapping = mmap (map, sizeof buf, 1, fd, 0);
+  if (mapping == MAP_FAILED)
+    fail ("mmap \"%s\"", file_name);
+  if (map[4096] != buf[4096])
+    fail ("mapping of \"%s\" has the wrong data", file_name);
+  return mapping;
+}
+
+void
+test_main (void) {
+  void *mapping;
+  int fd;
+
+  random_init (0);
+  random_bytes (buf, sizeof buf);
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  CHECK (write (fd, buf, sizeof buf) == sizeof buf,
+         "write \"%s\"", file_name);
+
+  /* Read bytes 0...511 into bytes 512...1023 of the same page. */
+  mapping = map_file (fd);
+  seek (fd, 0);
+  CHECK (read (fd, map + 512, 512) == 512, "read into mapping");
+  memcpy (buf + 512, buf, 512);
+  if (memcmp (map, buf, sizeof buf))
+    fail ("mapping has the wrong data after read()");
+  munmap (mapping);
+
+  /* Write bytes 0...511 of the page to offset 1024 of the file. */
+  mapping = map_file (fd);
+  seek (fd, 1024);
+  CHECK (write (fd, map, 512) == 512, "write from mapping");
+  memcpy (buf + 1024, buf, 512);
+  munmap (mapping);
+
+  close (fd);
+  check_file (file_name, buf, sizeof buf);
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(bc-mmap-self) begin
+(bc-mmap-self) create "self"
+(bc-mmap-self) open "self"
+(bc-mmap-self) write "self"
+(bc-mmap-self) read into mapping
+(bc-mmap-self) write from mapping
+(bc-mmap-self) open "self" for verification
+(bc-mmap-self) verified contents of "self"
+(bc-mmap-self) close "self"
+(bc-mmap-self) end
+EOF
+pass;
@@ -0,0 +1,56 @@
+/* Checks that a memory mapping of a file and read() and write()
+   on the file see one copy of its data.  Data written with
+   write() must show up in the mapping at once, and a store
+   through the mapping must be returned by read() while the
+   mapping is still in place. */
+
+#include <random.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE (2 * 4096)
+
+static const char file_name[] = "shared";
+static char buf[FILE_SIZE];
+
+void
+test_main (void) {
+  char *map = (char *) 0x10000000;
+  char data[512];
+  void *mapping;
+  int fd;
+
+  random_init (0);
+  random_bytes (buf, sizeof buf);
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  CHECK (write (fd, buf, sizeof buf) == sizeof buf,
+         "write \"%s\"", file_name);
+  CHECK ((mapping = mmap (map, sizeof buf, 1, fd, 0)) != MAP_FAILED,
+         "mmap \"%s\"", file_name);
+  if (memcmp (map, buf, sizeof buf))
+    fail ("mapping of \"%s\" has the wrong data", file_name);
+
+  /* write() to the file after the mapping was read in. */
+  memset (data, 'w', sizeof data);
+  seek (fd, 100);
+  CHECK (write (fd, data, sizeof data) == sizeof data,
+         "write \"%s\" at offset 100", file_name);
+  memcpy (buf + 100, data, sizeof data);
+  if (memcmp (map, buf, sizeof buf))
+    fail ("mapping does not show data written by write()");
+
+  /* Store through the mapping, then read() the same bytes. */
+  memset (map + 5000, 'm', sizeof data);
+  memset (buf + 5000, 'm', sizeof data);
+  seek (fd, 5000);
+  CHECK (read (fd, data, sizeof data) == sizeof data,
+         "read \"%s\" at offset 5000", file_name);
+  compare_bytes (data, buf + 5000, sizeof data, 5000, file_name);
+
+  munmap (mapping);
+  close (fd);
+  check_file (file_name, buf, sizeof buf);
+}
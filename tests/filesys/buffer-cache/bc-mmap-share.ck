@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(bc-mmap-share) begin
+(bc-mmap-share) create "shared"
+(bc-mmap-share) open "shared"
+(bc-mmap-share) write "shared"
+(bc-mmap-share) mmap "shared"
+(bc-mmap-share) write "shared" at offset 100
+(bc-mmap-share) read "shared" at offset 5000
+(bc-mmap-share) open "shared" for verification
+(bc-mmap-share) verified contents of "shared"
+(bc-mmap-share) close "shared"
+(bc-mmap-share) end
+EOF
+pass;
@@ -0,0 +1,66 @@
+/* Reads a few small files often enough for the cache to consider
+   them hot, then reads "scan", which is twice as big as the
+   default page cache, once from start to end.  Reading the small
+   files again afterward should still be served from the cache: a
+   single sequential scan must not evict frequently used data.
+
+   Regular file data is kept by the page cache, so that is the
+   cache this exercises.  The buffer cache, which holds the files'
+   inodes, sees only a few sectors and keeps them all. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define HOT_FILES 8
+
+/* Twice the default page cache of 64 pages. */
+#define SCAN_SIZE (2 * 64 * 4096)
+
+static char buf[512];
+
+static void
+read_hot_files (void) {
+  char name[16];
+  int i, fd;
+
+  for (i = 0; i < HOT_FILES; i++) {
+    snprintf (name, sizeof name, "hot%d", i);
+    if ((fd = open (name)) < 2)
+      fail ("open \"%s\"", name);
+    if (read (fd, buf, sizeof buf) != sizeof buf)
+      fail ("read \"%s\"", name);
+    close (fd);
+  }
+}
+
+void
+test_main (void) {
+  char name[16];
+  int i, fd;
+  long long read_cnt;
+
+  for (i = 0; i < HOT_FILES; i++) {
+    snprintf (name, sizeof name, "hot%d", i);
+    if (!create (name, sizeof buf))
+      fail ("create \"%s\"", name);
+  }
+  msg ("create hot files");
+
+  read_hot_files ();
+  read_hot_files ();
+  msg ("warm up hot files");
+
+  CHECK (create ("scan", SCAN_SIZE), "create \"scan\"");
+  CHECK ((fd = open ("scan")) > 1, "open \"scan\"");
+  while (read (fd, buf, sizeof buf) > 0)
+    continue;
+  msg ("read \"scan\"");
+  close (fd);
+
+  read_cnt = get_fs_disk_read_cnt ();
+  read_hot_files ();
+  CHECK (get_fs_disk_read_cnt () <= read_cnt + HOT_FILES / 2,
+         "check read_cnt");
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(bc-scan) begin
+(bc-scan) create hot files
+(bc-scan) warm up hot files
+(bc-scan) create "scan"
+(bc-scan) open "scan"
+(bc-scan) read "scan"
+(bc-scan) check read_cnt
+(bc-scan) end
+EOF
+pass;
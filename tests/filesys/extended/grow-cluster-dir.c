@@ -0,0 +1,7 @@
+/* Creates a directory, then creates 50 files in that directory,
+   on a file system formatted with 8-sector clusters, so that the
+   directory grows by whole clusters. */
+
+#define FILE_CNT 50
+#define DIRECTORY "/x"
+#include "tests/filesys/extended/grow-dir.inc"
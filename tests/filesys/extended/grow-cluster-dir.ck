@@ -0,0 +1,61 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-cluster-dir) begin
+(grow-cluster-dir) mkdir /x
+(grow-cluster-dir) creating and checking "/x/file0"
+(grow-cluster-dir) creating and checking "/x/file1"
+(grow-cluster-dir) creating and checking "/x/file2"
+(grow-cluster-dir) creating and checking "/x/file3"
+(grow-cluster-dir) creating and checking "/x/file4"
+(grow-cluster-dir) creating and checking "/x/file5"
+(grow-cluster-dir) creating and checking "/x/file6"
+(grow-cluster-dir) creating and checking "/x/file7"
+(grow-cluster-dir) creating and checking "/x/file8"
+(grow-cluster-dir) creating and checking "/x/file9"
+(grow-cluster-dir) creating and checking "/x/file10"
+(grow-cluster-dir) creating and checking "/x/file11"
+(grow-cluster-dir) creating and checking "/x/file12"
+(grow-cluster-dir) creating and checking "/x/file13"
+(grow-cluster-dir) creating and checking "/x/file14"
+(grow-cluster-dir) creating and checking "/x/file15"
+(grow-cluster-dir) creating and checking "/x/file16"
+(grow-cluster-dir) creating and checking "/x/file17"
+(grow-cluster-dir) creating and checking "/x/file18"
+(grow-cluster-dir) creating and checking "/x/file19"
+(grow-cluster-dir) creating and checking "/x/file20"
+(grow-cluster-dir) creating and checking "/x/file21"
+(grow-cluster-dir) creating and checking "/x/file22"
+(grow-cluster-dir) creating and checking "/x/file23"
+(grow-cluster-dir) creating and checking "/x/file24"
+(grow-cluster-dir) creating and checking "/x/file25"
+(grow-cluster-dir) creating and checking "/x/file26"
+(grow-cluster-dir) creating and checking "/x/file27"
+(grow-cluster-dir) creating and checking "/x/file28"
+(grow-cluster-dir) creating and checking "/x/file29"
+(grow-cluster-dir) creating and checking "/x/file30"
+(grow-cluster-dir) creating and checking "/x/file31"
+(grow-cluster-dir) creating and checking "/x/file32"
+(grow-cluster-dir) creating and checking "/x/file33"
+(grow-cluster-dir) creating and checking "/x/file34"
+(grow-cluster-dir) creating and checking "/x/file35"
+(grow-cluster-dir) creating and checking "/x/file36"
+(grow-cluster-dir) creating and checking "/x/file37"
+(grow-cluster-dir) creating and checking "/x/file38"
+(grow-cluster-dir) creating and checking "/x/file39"
+(grow-cluster-dir) creating and checking "/x/file40"
+(grow-cluster-dir) creating and checking "/x/file41"
+(grow-cluster-dir) creating and checking "/x/file42"
+(grow-cluster-dir) creating and checking "/x/file43"
+(grow-cluster-dir) creating and checking "/x/file44"
+(grow-cluster-dir) creating and checking "/x/file45"
+(grow-cluster-dir) creating and checking "/x/file46"
+(grow-cluster-dir) creating and checking "/x/file47"
+(grow-cluster-dir) creating and checking "/x/file48"
+(grow-cluster-dir) creating and checking "/x/file49"
+(grow-cluster-dir) end
+EOF
+pass;
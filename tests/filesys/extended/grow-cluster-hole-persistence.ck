@@ -0,0 +1,7 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_archive ({"testfile" => [("\0" x 100) . ("a" x 10) . ("\0" x 6890)
+			       . ("c" x 10) . ("\0" x 7990) . ("b" x 10)]});
+pass;
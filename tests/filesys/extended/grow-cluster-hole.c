@@ -0,0 +1,6 @@
+/* Runs grow-hole on a file system formatted with 8-sector
+   clusters, so that the bytes skipped over by seeking past the
+   end of the file include partial clusters on both sides of a
+   write as well as a whole cluster in between. */
+
+#include "tests/filesys/extended/grow-hole.inc"
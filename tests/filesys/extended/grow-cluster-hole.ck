@@ -0,0 +1,23 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-cluster-hole) begin
+(grow-cluster-hole) create "junk"
+(grow-cluster-hole) open "junk"
+(grow-cluster-hole) write "junk"
+(grow-cluster-hole) close "junk"
+(grow-cluster-hole) remove "junk"
+(grow-cluster-hole) create "testfile"
+(grow-cluster-hole) open "testfile"
+(grow-cluster-hole) write 10 'a' bytes at 100
+(grow-cluster-hole) write 10 'b' bytes at 15000
+(grow-cluster-hole) write 10 'c' bytes at 7000
+(grow-cluster-hole) close "testfile"
+(grow-cluster-hole) open "testfile" for verification
+(grow-cluster-hole) verified contents of "testfile"
+(grow-cluster-hole) close "testfile"
+(grow-cluster-hole) end
+EOF
+pass;
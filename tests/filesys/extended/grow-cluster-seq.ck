@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-cluster-seq) begin
+(grow-cluster-seq) create "testme"
+(grow-cluster-seq) open "testme"
+(grow-cluster-seq) writing "testme"
+(grow-cluster-seq) close "testme"
+(grow-cluster-seq) open "testme" for verification
+(grow-cluster-seq) verified contents of "testme"
+(grow-cluster-seq) close "testme"
+(grow-cluster-seq) end
+EOF
+pass;
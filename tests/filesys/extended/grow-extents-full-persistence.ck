@@ -0,0 +1,9 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+my ($data) = "\0" x (29 * 2048 + 1);
+substr ($data, $_ * 2048, 1) = chr (ord ('a') + $_ % 26) foreach 0...29;
+substr ($data, 3072, 1) = 'x';
+check_archive ({"testfile" => [$data]});
+pass;
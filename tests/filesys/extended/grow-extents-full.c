@@ -0,0 +1,65 @@
+/* Gives a file exactly as many extents as fit in its inode, fills
+   the disk, and then frees a single cluster.  Writing into the
+   middle of one of the file's holes can then allocate the cluster
+   for the write but not the extent block that splitting the hole
+   needs, so the write must fail and leave the file as it was.
+   Once space is freed, the same write must succeed. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define WRITE_CNT 30
+#define STRIDE 2048
+#define HOLE_OFS 3072
+
+static char buf[(WRITE_CNT - 1) * STRIDE + 1];
+static char fill[4096];
+
+/* Writes FILL to FD in SIZE-byte chunks until the disk is full. */
+static void
+fill_disk (int fd, size_t size)
+{
+  while (write (fd, fill, size) == (int) size)
+    continue;
+}
+
+void
+test_main (void)
+{
+  const char *file_name = "testfile";
+  int fd, filler_fd;
+  int i;
+
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  msg ("write %d bytes %d bytes apart", WRITE_CNT, STRIDE);
+  for (i = 0; i < WRITE_CNT; i++)
+    {
+      buf[i * STRIDE] = 'a' + i % 26;
+      seek (fd, i * STRIDE);
+      if (write (fd, buf + i * STRIDE, 1) != 1)
+        fail ("write at %d failed", i * STRIDE);
+    }
+
+  CHECK (create ("spare", 0), "create \"spare\"");
+  CHECK (create ("filler", 0), "create \"filler\"");
+  CHECK ((filler_fd = open ("filler")) > 1, "open \"filler\"");
+  msg ("fill the disk");
+  fill_disk (filler_fd, sizeof fill);
+  fill_disk (filler_fd, 512);
+  CHECK (remove ("spare"), "remove \"spare\"");
+
+  seek (fd, HOLE_OFS);
+  CHECK (write (fd, "x", 1) == 0, "write into a hole with one free cluster");
+
+  msg ("close \"filler\"");
+  close (filler_fd);
+  CHECK (remove ("filler"), "remove \"filler\"");
+  buf[HOLE_OFS] = 'x';
+  seek (fd, HOLE_OFS);
+  CHECK (write (fd, "x", 1) == 1, "write into the hole again");
+  msg ("close \"%s\"", file_name);
+  close (fd);
+  check_file (file_name, buf, sizeof buf);
+}
@@ -0,0 +1,25 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-extents-full) begin
+(grow-extents-full) create "testfile"
+(grow-extents-full) open "testfile"
+(grow-extents-full) write 30 bytes 2048 bytes apart
+(grow-extents-full) create "spare"
+(grow-extents-full) create "filler"
+(grow-extents-full) open "filler"
+(grow-extents-full) fill the disk
+(grow-extents-full) remove "spare"
+(grow-extents-full) write into a hole with one free cluster
+(grow-extents-full) close "filler"
+(grow-extents-full) remove "filler"
+(grow-extents-full) write into the hole again
+(grow-extents-full) close "testfile"
+(grow-extents-full) open "testfile" for verification
+(grow-extents-full) verified contents of "testfile"
+(grow-extents-full) close "testfile"
+(grow-extents-full) end
+EOF
+pass;
@@ -0,0 +1,8 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+my ($data) = "\0" x (69 * 1024 + 1);
+substr ($data, $_ * 1024, 1) = chr (ord ('a') + $_ % 26) foreach 0...69;
+check_archive ({"testfile" => [$data]});
+pass;
@@ -0,0 +1,37 @@
+/* Grows a file one byte at a time, seeking a cluster past its end
+   before each write, so that every write adds a hole and a run of
+   data to its extents.  That overflows the extents kept in the
+   inode into an extent block and then fills the extent block,
+   after which the skipped sectors must be allocated as zeros
+   instead. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define WRITE_CNT 70
+#define STRIDE 1024
+
+static char buf[(WRITE_CNT - 1) * STRIDE + 1];
+
+void
+test_main (void)
+{
+  const char *file_name = "testfile";
+  int fd;
+  int i;
+
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  msg ("write %d bytes %d bytes apart", WRITE_CNT, STRIDE);
+  for (i = 0; i < WRITE_CNT; i++)
+    {
+      buf[i * STRIDE] = 'a' + i % 26;
+      seek (fd, i * STRIDE);
+      if (write (fd, buf + i * STRIDE, 1) != 1)
+        fail ("write at %d failed", i * STRIDE);
+    }
+  msg ("close \"%s\"", file_name);
+  close (fd);
+  check_file (file_name, buf, sizeof buf);
+}
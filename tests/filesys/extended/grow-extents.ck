@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-extents) begin
+(grow-extents) create "testfile"
+(grow-extents) open "testfile"
+(grow-extents) write 70 bytes 1024 bytes apart
+(grow-extents) close "testfile"
+(grow-extents) open "testfile" for verification
+(grow-extents) verified contents of "testfile"
+(grow-extents) close "testfile"
+(grow-extents) end
+EOF
+pass;
@@ -0,0 +1,9 @@
+/* Tests that the bytes of a file that were skipped over by
+   seeking past its end read as zeros, both in the cluster a
+   write lands in and in the clusters between, and that writing
+   into the middle of such a region leaves the rest of it zero.
+   A file full of nonzero data is written and removed first, so
+   that the clusters reused for the test file are not zero to
+   begin with. */
+
+#include "tests/filesys/extended/grow-hole.inc"
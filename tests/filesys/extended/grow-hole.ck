@@ -0,0 +1,23 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-hole) begin
+(grow-hole) create "junk"
+(grow-hole) open "junk"
+(grow-hole) write "junk"
+(grow-hole) close "junk"
+(grow-hole) remove "junk"
+(grow-hole) create "testfile"
+(grow-hole) open "testfile"
+(grow-hole) write 10 'a' bytes at 100
+(grow-hole) write 10 'b' bytes at 15000
+(grow-hole) write 10 'c' bytes at 7000
+(grow-hole) close "testfile"
+(grow-hole) open "testfile" for verification
+(grow-hole) verified contents of "testfile"
+(grow-hole) close "testfile"
+(grow-hole) end
+EOF
+pass;
@@ -34,8 +34,13 @@
 #endif
 #ifdef FILESYS
 #include "devices/disk.h"
+#include "devices/ramdisk.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
+#include "filesys/fat.h"
+#ifdef EFILESYS
+#include "filesys/page_cache.h"
+#endif
 #endif
 
 /* Page-map-level-4 with kernel mappings only. */
@@ -44,6 +49,10 @@ uint64_t *base_pml4;
 #ifdef FILESYS
 /* -f: Format the file system? */
 static bool format_filesys;
+
+/* -ramfs, -ramswap: Sizes in MB of RAM disks to use as the file
+   system and swap disks, or 0 to use the real ones. */
+static int ramfs_mb, ramswap_mb;
 #endif
 
 /* -q: Power off after kernel tasks complete? */
@@ -109,6 +118,10 @@ main (void) {
 #ifdef FILESYS
 	/* Initialize file system. */
 	disk_init ();
+	if (ramfs_mb > 0)
+		disk_register (ramdisk_create ("ramfs", ramfs_mb * 2048), 0, 1);
+	if (ramswap_mb > 0)
+		disk_register (ramdisk_create ("ramswap", ramswap_mb * 2048), 1, 1);
 	filesys_init (format_filesys);
 #endif
 
@@ -216,6 +229,26 @@ parse_options (char **argv) {
 #ifdef FILESYS
 		else if (!strcmp (name, "-f"))
 			format_filesys = true;
+		else if (!strcmp (name, "-bc"))
+			buffer_cache_mb = atoi (value);
+		else if (!strcmp (name, "-pio"))
+			disk_pio = true;
+		else if (!strcmp (name, "-ramfs"))
+			ramfs_mb = atoi (value);
+		else if (!strcmp (name, "-ramswap"))
+			ramswap_mb = atoi (value);
+#ifdef EFILESYS
+		else if (!strcmp (name, "-pc"))
+			page_cache_mb = atoi (value);
+		else if (!strcmp (name, "-cluster")) {
+			format_cluster_sectors = atoi (value);
+			if (format_cluster_sectors == 0
+					|| (format_cluster_sectors & (format_cluster_sectors - 1)) != 0
+					|| format_cluster_sectors > MAX_SECTORS_PER_CLUSTER)
+				PANIC ("-cluster must be a power of 2 up to %d",
+						MAX_SECTORS_PER_CLUSTER);
+		}
+#endif
 #endif
 		else if (!strcmp (name, "-rs"))
 			random_init (atoi (value));
@@ -324,6 +357,16 @@ usage (void) {
 			"  -h                 Print this help message and power off.\n"
 			"  -q                 Power off VM after actions or on panic.\n"
 			"  -f                 Format file system disk during startup.\n"
+#ifdef FILESYS
+			"  -bc=MB             Use MB megabytes of memory for the buffer cache.\n"
+			"  -pio               Transfer disk data by PIO, never by DMA.\n"
+			"  -ramfs=MB          Keep the file system on an MB-megabyte RAM disk.\n"
+			"  -ramswap=MB        Swap to an MB-megabyte RAM disk.\n"
+#ifdef EFILESYS
+			"  -pc=MB             Use MB megabytes of memory for the page cache.\n"
+			"  -cluster=SECTORS   Format with clusters of SECTORS sectors.\n"
+#endif
+#endif
 			"  -rs=SEED           Set random number seed to SEED.\n"
 			"  -mlfqs             Use multi-level feedback queue scheduler.\n"
 #ifdef USERPROG
@@ -356,6 +399,7 @@ print_stats (void) {
 	thread_print_stats ();
 #ifdef FILESYS
 	disk_print_stats ();
+	buffer_cache_print_stats ();
 #endif
 	console_print_stats ();
 	kbd_print_stats ();
@@ -15,6 +15,7 @@
 #include "userprog/process.h"
 #endif
 #include "filesys/fat.h"
+#include "filesys/filesys.h"
 
 /* Random value for struct thread's `magic' member.
    Used to detect stack overflow.  See the big comment at the top
@@ -566,7 +567,9 @@ init_thread (struct thread *t, const char *name, int priority) {
 
 	if(t==initial_thread){
 		// t->cwd_cluster = ROOT_DIR_CLUSTER;
-		t->cur_sector = cluster_to_sector(ROOT_DIR_CLUSTER);
+		/* The file system is not up yet; filesys_init() moves this
+		 * to where the root directory really is. */
+		t->cur_sector = ROOT_DIR_SECTOR;
 		
 
 	} else {
@@ -20,8 +20,8 @@ void halt(void);
 void exit(int status);
 int write(uintptr_t user_rsp, int fd, const void* buffer, unsigned size);
 int read(uintptr_t user_rsp, int fd, void* buffer, unsigned size);
-unsigned tell (int fd);
-int seek(int fd, unsigned position);
+off_t tell (int fd);
+int seek(int fd, off_t position);
 tid_t fork(const char *name, struct intr_frame *if_);
 int dup2(int oldfd, int newfd);
 
@@ -188,9 +188,9 @@ int open(const char *file){
 	return fd;
 }
 
-int filesize(int fd){
+off_t filesize(int fd){
 	if(thread_current()->fd[fd] != NULL){
-		return (int)file_length(thread_current()->fd[fd]);
+		return file_length(thread_current()->fd[fd]);
 	}
 	return -1;
 }
@@ -327,7 +327,7 @@ int read(uintptr_t user_rsp, int fd, void* buffer, unsigned size){
 	return size;
 }
 
-unsigned tell (int fd){
+off_t tell (int fd){
 	if((thread_current()->fd)[fd]==NULL){
 		return -1;
 	}
@@ -340,15 +340,15 @@ unsigned tell (int fd){
 		return -1;
 	}
 
-	int res;
+	off_t res;
 	lock_acquire(&file_lock);
 	res = file_tell((thread_current()->fd)[fd]);
 	lock_release(&file_lock);
 	return res;
 }
 
-int seek(int fd, unsigned position){
-	if((thread_current()->fd)[fd]==NULL){
+int seek(int fd, off_t position){
+	if((thread_current()->fd)[fd]==NULL || position < 0){
 		return -1;
 	}
 
@@ -511,6 +511,38 @@ int symlink(const char *target, const char *linkpath){
 	return filesys_symlink(target, linkpath);
 }
 
+static bool fsstat(struct fsstat *st){
+	struct fsstat kst;
+	uint8_t *upage;
+
+	if(st == NULL){
+		exit(-1);
+	}
+
+	if (!(is_user_vaddr(st)) || !(is_user_vaddr((uint8_t *)(st + 1) - 1))){
+		exit(-1);
+	}
+
+	/* Every page of ST must be mapped and writable, checked the
+	 * same way as read()'s buffer. */
+	for(upage = pg_round_down(st); upage < (uint8_t *)(st + 1); upage += PGSIZE){
+		if(!(pml4e_walk (thread_current()->pml4, (uint64_t) upage, 0))){
+			exit(-1);
+		}
+#ifdef VM
+		if(upage < (uint8_t *) pg_round_down(thread_current()->user_rsp)){
+			struct page *page = spt_find_page(&thread_current()->spt, upage);
+			if(page == NULL || page->writable_real == false){
+				exit(-1);
+			}
+		}
+#endif
+	}
+	buffer_cache_get_stats(&kst);
+	memcpy(st, &kst, sizeof kst);
+	return true;
+}
+
 
 /* The main system call interface */
 void
@@ -562,8 +594,7 @@ syscall_handler (struct intr_frame *f) {
 		f->R.rax = fd;
 		break;
 	case SYS_FILESIZE:
-		fd = filesize((int)(f->R.rdi));
-		f->R.rax = fd;
+		f->R.rax = filesize((int)(f->R.rdi));
 		break;
 	case SYS_READ:
 		// printf("user rsp %p\n", t->user_rsp);
@@ -584,9 +615,8 @@ syscall_handler (struct intr_frame *f) {
 		f->R.rax = res;
 		break;
 	case SYS_TELL:
-		res = tell((int)(f->R.rdi));
-		thread_current()->tf.R.rax = res;
-		f->R.rax = res;
+		f->R.rax = tell((int)(f->R.rdi));
+		thread_current()->tf.R.rax = f->R.rax;
 		break;
 	case SYS_CLOSE:
 		close((int)(f->R.rdi));
@@ -621,6 +651,9 @@ syscall_handler (struct intr_frame *f) {
 	case SYS_SYMLINK:
 		f->R.rax = symlink(f->R.rdi, f->R.rsi);
 		break;
+	case SYS_FSSTAT:
+		f->R.rax = fsstat((struct fsstat *) f->R.rdi);
+		break;
 	default:
 		break;
 	}
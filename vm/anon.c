@@ -66,11 +66,8 @@ anon_swap_in (struct page *page, void *kva) {
 
 	// printf("num %d\n", num);
 	// page->frame->page = page;
-	int i = 0;
 	lock_acquire(&file_lock);
-	for (i=0;i<8;i++){
-		disk_read(swap_disk, num*8 + i, (page->va) + i * DISK_SECTOR_SIZE);
-	}
+	disk_read_multi(swap_disk, num*8, kva, 8);
 	lock_release(&file_lock);
 
 	bitmap_set(swap_slot_bitmap, num, false);
@@ -95,11 +92,8 @@ anon_swap_out (struct page *page) {
 	anon_page -> slot_num = num;
 
 	// printf("swap out\n");
-	int i = 0;
 	lock_acquire(&file_lock);
-	for (i=0;i<8;i++){
-		disk_write(swap_disk, num*8 + i, (page->va)+ i * DISK_SECTOR_SIZE);
-	}
+	disk_write_multi(swap_disk, num*8, page->frame->kva, 8);
 	lock_release(&file_lock);
 
 	bitmap_set(swap_slot_bitmap, num, true);
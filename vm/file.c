@@ -1,6 +1,8 @@
 /* file.c: Implementation of memory backed file object (mmaped object). */
 
 #include "vm/vm.h"
+#include <string.h>
+#include "threads/malloc.h"
 #include "threads/vaddr.h"
 #include "userprog/process.h"
 #include "threads/mmu.h"
@@ -34,12 +36,67 @@ file_backed_initializer (struct page *page, enum vm_type type, void *kva) {
 
 	struct file_page *file_page = &page->file;
 	file_page->info = info;
+	file_page->cache = NULL;
 
 	list_push_back(frame_list, &page->frame->frame_elem);
 	// printf("file_backed_init end\n");
 	return true;
 }
 
+#ifdef EFILESYS
+/* Returns true if PAGE maps its page cache page rather than a
+ * private copy, which a copy-on-write fault may have given it. */
+static bool
+file_page_is_shared (struct page *page) {
+	struct page *cache = page->file.cache;
+	return cache != NULL && page->frame->kva == cache->frame->kva;
+}
+
+/* Claims PAGE, an mmap'd page not loaded yet, by mapping the page
+ * cache's copy of its data, so that the mapping and read() share
+ * it.  Only whole pages qualify: the rest of a last partial page
+ * must read as zeros.  The frame is the page cache's and is never
+ * put on the frame list for eviction.  Returns false, leaving PAGE
+ * alone, if the page cannot be shared. */
+bool
+file_backed_share (struct page *page) {
+	struct segment_info *aux, *info;
+	struct frame *frame;
+	struct page *cache;
+
+	if (page->operations->type != VM_UNINIT
+			|| VM_TYPE (page->uninit.type) != VM_FILE)
+		return false;
+	aux = page->uninit.aux;
+	if (!(aux->type & VM_MARKER_0) || aux->page_read_bytes != PGSIZE)
+		return false;
+
+	cache = page_cache_share (file_get_inode (aux->file), aux->ofs,
+			aux->writable);
+	if (cache == NULL)
+		return false;
+	info = malloc (sizeof *info);
+	frame = malloc (sizeof *frame);
+	if (info == NULL || frame == NULL
+			|| !pml4_set_page (thread_current ()->pml4, page->va,
+				cache->frame->kva, page->writable)) {
+		free (info);
+		free (frame);
+		page_cache_unshare (cache);
+		return false;
+	}
+	memcpy (info, aux, sizeof *info);
+	frame->kva = cache->frame->kva;
+	frame->page = page;
+
+	page->frame = frame;
+	page->operations = &file_ops;
+	page->file.info = info;
+	page->file.cache = cache;
+	return true;
+}
+#endif
+
 /* Swap in the page by read contents from the file. */
 static bool
 file_backed_swap_in (struct page *page, void *kva) {
@@ -79,6 +136,17 @@ file_backed_destroy (struct page *page) {
 		// printf("here\n");
 		do_munmap(page->va);
 	}
+#ifdef EFILESYS
+	if(file_page->cache != NULL){
+		/* The frame belongs to the page cache, so it must be gone
+		 * from the page table before pml4_destroy() frees what
+		 * the table maps. */
+		if(file_page_is_shared(page))
+			pml4_clear_page(thread_current()->pml4, page->va);
+		page_cache_unshare(file_page->cache);
+		file_page->cache = NULL;
+	}
+#endif
 }
 
 /* Do the mmap */
@@ -91,19 +159,19 @@ do_mmap (void *addr, size_t length, int writable,
 		return NULL;
 	}
 
-	if(pg_ofs(addr)!=0 || offset % PGSIZE != 0){
+	if(pg_ofs(addr)!=0 || offset < 0 || offset % PGSIZE != 0){
 		return NULL;
 	}
 
 	uint32_t read_bytes = 0;
 	uint32_t zero_bytes = 0;
-	int full_pages = length;
+	size_t full_pages = length;
 	// printf("length %d\n", length);
 	if(length % PGSIZE != 0){
 		full_pages = (length / PGSIZE + 1) * PGSIZE;
 	}
-	int len_file = file_length(file);
-	if(len_file<length){
+	off_t len_file = file_length(file);
+	if((uint64_t) len_file < length){
 		// printf("here");
 		if(len_file % PGSIZE != 0){
 			full_pages = (len_file / PGSIZE + 1) * PGSIZE;
@@ -112,7 +180,7 @@ do_mmap (void *addr, size_t length, int writable,
 			full_pages = length;
 		}
 	}
-	if(len_file < full_pages){
+	if((uint64_t) len_file < full_pages){
 		read_bytes = len_file;
 		zero_bytes = full_pages - len_file;
 	} else {
@@ -149,6 +217,18 @@ do_munmap (void *addr) {
 	struct segment_info *info = (struct segment_info*)page->file.info;
 	struct file *file = info->file;
 
+#ifdef EFILESYS
+	/* Stores went straight to the page cache; it only needs to
+	 * know that they happened. */
+	if(file_page_is_shared(page)){
+		if(pml4_is_dirty(thread_current()->pml4, addr) && info->writable){
+			page_cache_mark_dirty(page->file.cache);
+			pml4_set_dirty(thread_current()->pml4, addr, false);
+		}
+		return;
+	}
+#endif
+
 	if(pml4_is_dirty(thread_current()->pml4, addr)){
 		if(info->writable){
 			// printf("dounmap file %p\n", info->file);
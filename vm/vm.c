@@ -348,6 +348,12 @@ vm_claim_page (void *va) {
 /* Claim the PAGE and set up the mmu. */
 static bool
 vm_do_claim_page (struct page *page) {
+#ifdef EFILESYS
+	/* A page of an mmap'd file maps the page cache's copy if it can. */
+	if (file_backed_share (page))
+		return true;
+#endif
+
 	lock_acquire(&evit_lock);
 	struct frame *frame = vm_get_frame ();
 	lock_release(&evit_lock);
@@ -562,6 +568,14 @@ supplemental_page_table_copy (struct supplemental_page_table *dst ,
 			// bool ret = swap_in (newpage, frame->kva);
 			// bool ret = swap_in (newpage, newpage->frame->kva);
 			newpage->operations = page->operations;
+			newpage->file.info = info;
+#ifdef EFILESYS
+			/* The child maps the same page cache page, if the
+			 * parent does, and holds it until it unmaps it. */
+			newpage->file.cache = page->file.cache;
+			if(newpage->file.cache != NULL)
+				page_cache_dup(newpage->file.cache);
+#endif
 
 		}
 